@@ -166,6 +166,9 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
         "Available actions:\n"
         "  quit            Quit the currently running app\n"
         "  stream          Start streaming an app\n"
+        "  replay          Replay a decode unit capture file\n"
+        "  pacerbench      Benchmark frame pacing with simulated frames\n"
+        "  copybench       Benchmark copying video planes\n"
         "\n"
         "See 'moonlight <action> --help' for help of specific action."
     );
@@ -193,6 +196,12 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
                 return QuitRequested;
             } else if (action == "stream") {
                 return StreamRequested;
+            } else if (action == "replay") {
+                return ReplayRequested;
+            } else if (action == "pacerbench") {
+                return PacerBenchRequested;
+            } else if (action == "copybench") {
+                return CopyBenchRequested;
             }
         }
 
@@ -441,3 +450,230 @@ QString StreamCommandLineParser::getAppName() const
 {
     return m_AppName;
 }
+
+ReplayCommandLineParser::ReplayCommandLineParser()
+    : m_MaxSpeed(false)
+{
+    m_VideoDecoderMap = {
+        {"auto",     StreamingPreferences::VDS_AUTO},
+        {"software", StreamingPreferences::VDS_FORCE_SOFTWARE},
+        {"hardware", StreamingPreferences::VDS_FORCE_HARDWARE},
+    };
+}
+
+ReplayCommandLineParser::~ReplayCommandLineParser()
+{
+}
+
+void ReplayCommandLineParser::parse(const QStringList &args, StreamingPreferences *preferences)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Decode and render a stream captured with DECODE_UNIT_CAPTURE=<file>,\n"
+        "then print the video stats."
+    );
+    parser.addPositionalArgument("replay", "replay decode units");
+    parser.addPositionalArgument("file", "Decode unit capture file", "<file>");
+
+    parser.addFlagOption("max-speed", "maximum speed instead of the recorded timing");
+    parser.addToggleOption("vsync", "V-Sync");
+    parser.addToggleOption("frame-pacing", "frame pacing");
+    parser.addChoiceOption("video-decoder", "video decoder", m_VideoDecoderMap.keys());
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    m_MaxSpeed = parser.isSet("max-speed");
+
+    // Resolve --vsync and --no-vsync options
+    preferences->enableVsync = parser.getToggleOptionValue("vsync", preferences->enableVsync);
+
+    // Resolve --frame-pacing and --no-frame-pacing options
+    preferences->framePacing = parser.getToggleOptionValue("frame-pacing", preferences->framePacing);
+
+    // Resolve --video-decoder option
+    if (parser.isSet("video-decoder")) {
+        preferences->videoDecoderSelection = mapValue(m_VideoDecoderMap, parser.getChoiceOptionValue("video-decoder"));
+    }
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    // Verify that the capture file has been provided
+    auto posArgs = parser.positionalArguments();
+    if (posArgs.length() < 2) {
+        parser.showError("Capture file not provided");
+    }
+    m_FileName = posArgs.at(1);
+}
+
+QString ReplayCommandLineParser::getFileName() const
+{
+    return m_FileName;
+}
+
+bool ReplayCommandLineParser::isMaxSpeed() const
+{
+    return m_MaxSpeed;
+}
+
+PacerBenchCommandLineParser::PacerBenchCommandLineParser()
+{
+    m_PatternMap = {
+        {"constant", CliPacerBench::AP_CONSTANT},
+        {"jitter",   CliPacerBench::AP_JITTER},
+        {"burst",    CliPacerBench::AP_BURST},
+        {"stall",    CliPacerBench::AP_STALL},
+        {"drift",    CliPacerBench::AP_DRIFT},
+    };
+    m_PolicyMap = {
+        {"all",       PACING_POLICY_ALL},
+        {"immediate", PACING_POLICY_IMMEDIATE},
+        {"queue",     PACING_POLICY_QUEUE},
+        {"pts",       PACING_POLICY_PTS},
+    };
+}
+
+PacerBenchCommandLineParser::~PacerBenchCommandLineParser()
+{
+}
+
+void PacerBenchCommandLineParser::parse(const QStringList &args, CliPacerBench::PBENCH_PARAMETERS params)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Feed frames with a synthetic arrival pattern through each frame pacing\n"
+        "policy to a simulated display, then print dropped frames, latency and\n"
+        "the variation in time between displayed frames."
+    );
+    parser.addPositionalArgument("pacerbench", "benchmark frame pacing");
+
+    parser.addChoiceOption("pattern", "frame arrival pattern", m_PatternMap.keys());
+    parser.addChoiceOption("policy", "pacing policy", m_PolicyMap.keys());
+    parser.addValueOption("stream-fps", "stream FPS");
+    parser.addValueOption("display-fps", "display refresh rate");
+    parser.addValueOption("duration", "seconds per policy");
+    parser.addValueOption("magnitude-ms", "jitter deviation, burst hold or stall length in ms");
+    parser.addValueOption("drift-ppm", "host clock drift in ppm");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    params->pattern = CliPacerBench::AP_CONSTANT;
+    params->policies = PACING_POLICY_ALL;
+    params->streamFps = 60;
+    params->displayFps = 60;
+    params->durationSecs = 10;
+    params->magnitudeMs = 0;
+    params->driftPpm = 0;
+
+    // Resolve --pattern option
+    if (parser.isSet("pattern")) {
+        params->pattern = mapValue(m_PatternMap, parser.getChoiceOptionValue("pattern"));
+    }
+
+    // Resolve --policy option
+    if (parser.isSet("policy")) {
+        params->policies = mapValue(m_PolicyMap, parser.getChoiceOptionValue("policy"));
+    }
+
+    // Resolve --stream-fps option
+    if (parser.isSet("stream-fps")) {
+        params->streamFps = parser.getIntOption("stream-fps");
+        if (!inRange(params->streamFps, 10, 240)) {
+            parser.showError("Stream FPS must be in range: 10 - 240");
+        }
+    }
+
+    // Resolve --display-fps option
+    if (parser.isSet("display-fps")) {
+        params->displayFps = parser.getIntOption("display-fps");
+        if (!inRange(params->displayFps, 10, 240)) {
+            parser.showError("Display refresh rate must be in range: 10 - 240");
+        }
+    }
+
+    // Resolve --duration option
+    if (parser.isSet("duration")) {
+        params->durationSecs = parser.getIntOption("duration");
+        if (!inRange(params->durationSecs, 1, 3600)) {
+            parser.showError("Duration must be in range: 1 - 3600");
+        }
+    }
+
+    // Resolve --magnitude-ms option
+    if (parser.isSet("magnitude-ms")) {
+        params->magnitudeMs = parser.getIntOption("magnitude-ms");
+        if (!inRange(params->magnitudeMs, 1, 1000)) {
+            parser.showError("Magnitude must be in range: 1 - 1000");
+        }
+    }
+
+    // Resolve --drift-ppm option
+    if (parser.isSet("drift-ppm")) {
+        params->driftPpm = parser.getIntOption("drift-ppm");
+        if (!inRange(params->driftPpm, -10000, 10000)) {
+            parser.showError("Drift must be in range: -10000 - 10000");
+        }
+    }
+}
+
+CopyBenchCommandLineParser::CopyBenchCommandLineParser()
+    : m_Iterations(100)
+{
+}
+
+CopyBenchCommandLineParser::~CopyBenchCommandLineParser()
+{
+}
+
+void CopyBenchCommandLineParser::parse(const QStringList &args)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Time each plane copy kernel this CPU supports on 1080p and 4K planes."
+    );
+    parser.addPositionalArgument("copybench", "benchmark plane copies");
+
+    parser.addValueOption("iterations", "copies of each plane");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    // Resolve --iterations option
+    if (parser.isSet("iterations")) {
+        m_Iterations = parser.getIntOption("iterations");
+        if (!inRange(m_Iterations, 1, 100000)) {
+            parser.showError("Iterations must be in range: 1 - 100000");
+        }
+    }
+}
+
+int CopyBenchCommandLineParser::getIterations() const
+{
+    return m_Iterations;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "pacerbench.h"
 #include "settings/streamingpreferences.h"
 
 #include <QMap>
@@ -12,6 +13,9 @@ public:
         NormalStartRequested,
         StreamRequested,
         QuitRequested,
+        ReplayRequested,
+        PacerBenchRequested,
+        CopyBenchRequested,
     };
 
     GlobalCommandLineParser();
@@ -54,3 +58,47 @@ private:
     QMap<QString, StreamingPreferences::VideoCodecConfig> m_VideoCodecMap;
     QMap<QString, StreamingPreferences::VideoDecoderSelection> m_VideoDecoderMap;
 };
+
+class ReplayCommandLineParser
+{
+public:
+    ReplayCommandLineParser();
+    virtual ~ReplayCommandLineParser();
+
+    void parse(const QStringList &args, StreamingPreferences *preferences);
+
+    QString getFileName() const;
+    bool isMaxSpeed() const;
+
+private:
+    QString m_FileName;
+    bool m_MaxSpeed;
+    QMap<QString, StreamingPreferences::VideoDecoderSelection> m_VideoDecoderMap;
+};
+
+class PacerBenchCommandLineParser
+{
+public:
+    PacerBenchCommandLineParser();
+    virtual ~PacerBenchCommandLineParser();
+
+    void parse(const QStringList &args, CliPacerBench::PBENCH_PARAMETERS params);
+
+private:
+    QMap<QString, CliPacerBench::ArrivalPattern> m_PatternMap;
+    QMap<QString, int> m_PolicyMap;
+};
+
+class CopyBenchCommandLineParser
+{
+public:
+    CopyBenchCommandLineParser();
+    virtual ~CopyBenchCommandLineParser();
+
+    void parse(const QStringList &args);
+
+    int getIterations() const;
+
+private:
+    int m_Iterations;
+};
@@ -0,0 +1,100 @@
+#include "copybench.h"
+
+#include "streaming/streamutils.h"
+#include "streaming/video/planecopy.h"
+
+#include <QByteArray>
+
+// FFmpeg pads lines to its SIMD alignment, while GPU textures
+// are commonly padded further
+#define FRAME_PITCH_ALIGNMENT 64
+#define TEXTURE_PITCH_ALIGNMENT 256
+
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+namespace CliCopyBench
+{
+
+Benchmark::Benchmark(int iterations)
+    : m_Iterations(iterations)
+{
+
+}
+
+bool Benchmark::runPlane(const char* name, int widthBytes, int height)
+{
+    // Make sure the pitches never match, so each line is copied separately
+    int srcPitch = ALIGN(widthBytes, FRAME_PITCH_ALIGNMENT);
+    int dstPitch = ALIGN(widthBytes + 1, TEXTURE_PITCH_ALIGNMENT);
+
+    // Offset the destination like a texture mapping that isn't page-aligned
+    QByteArray src(srcPitch * height, Qt::Uninitialized);
+    QByteArray dst(dstPitch * height + 16, Qt::Uninitialized);
+    Uint8* srcData = (Uint8*)src.data();
+    Uint8* dstData = (Uint8*)dst.data() + 16;
+
+    for (int i = 0; i < src.size(); i++) {
+        srcData[i] = (Uint8)(i * 7 + (i >> 11));
+    }
+
+    for (int kernel = 0; kernel < PCK_MAX; kernel++) {
+        if (!PlaneCopy::isKernelSupported((PlaneCopyKernel)kernel)) {
+            continue;
+        }
+
+        for (int nonTemporal = 0; nonTemporal < 2; nonTemporal++) {
+            memset(dstData, 0, dstPitch * height);
+
+            Uint64 startTimeUs = StreamUtils::getMicroseconds();
+            for (int i = 0; i < m_Iterations; i++) {
+                PlaneCopy::copyPlane((PlaneCopyKernel)kernel, nonTemporal != 0,
+                                     dstData, dstPitch,
+                                     srcData, srcPitch,
+                                     widthBytes, height);
+            }
+            Uint64 elapsedUs = SDL_max(StreamUtils::getMicroseconds() - startTimeUs, (Uint64)1);
+
+            // Every kernel must produce the same visible pixels
+            for (int y = 0; y < height; y++) {
+                if (memcmp(dstData + y * dstPitch, srcData + y * srcPitch, widthBytes) != 0) {
+                    fprintf(stderr,
+                            "%s %s%s copy is wrong on line %d\n",
+                            name,
+                            PlaneCopy::getKernelName((PlaneCopyKernel)kernel),
+                            nonTemporal ? " non-temporal" : "",
+                            y);
+                    return false;
+                }
+            }
+
+            fprintf(stdout,
+                    "%-12s %-8s %-14s %8.3f ms %8.2f GB/s\n",
+                    name,
+                    PlaneCopy::getKernelName((PlaneCopyKernel)kernel),
+                    nonTemporal ? "non-temporal" : "temporal",
+                    elapsedUs / 1000.0 / m_Iterations,
+                    (double)widthBytes * height * m_Iterations / elapsedUs / 1000.0);
+        }
+    }
+
+    return true;
+}
+
+int Benchmark::exec()
+{
+    fprintf(stdout,
+            "Average of %d copies of each plane\n\n",
+            m_Iterations);
+
+    // NV12 luma planes and their interleaved chroma planes
+    if (!runPlane("1080p luma", 1920, 1080) ||
+            !runPlane("1080p chroma", 1920, 540) ||
+            !runPlane("4K luma", 3840, 2160) ||
+            !runPlane("4K chroma", 3840, 1080)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <SDL.h>
+
+namespace CliCopyBench
+{
+
+// Times each plane copy kernel on 1080p and 4K NV12 planes, with
+// pitches that differ between the frame and the texture like they
+// do in practice.
+class Benchmark
+{
+public:
+    Benchmark(int iterations);
+
+    int exec();
+
+private:
+    bool runPlane(const char* name, int widthBytes, int height);
+
+    int m_Iterations;
+};
+
+}
@@ -0,0 +1,421 @@
+#include "pacerbench.h"
+
+#include "streaming/streamutils.h"
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+
+#include <random>
+
+// Wi-Fi power saving and frame aggregation hold back frames
+// for a while and then deliver them all at once
+#define BURST_INTERVAL_MS 100
+#define DEFAULT_BURST_HOLD_MS 30
+
+// Rare but long interruptions, like a channel scan
+#define STALL_INTERVAL_MS 2000
+#define DEFAULT_STALL_MS 150
+
+#define DEFAULT_JITTER_MS 4
+#define DEFAULT_DRIFT_PPM 2000
+
+namespace CliPacerBench
+{
+
+// SDL_Delay() alone can oversleep by a millisecond or more, which would
+// show up as jitter in the simulated display, so spin for the remainder.
+static void sleepUntil(Uint64 timeUs)
+{
+    Uint64 nowUs = StreamUtils::getMicroseconds();
+    if (timeUs > nowUs + 2000) {
+        SDL_Delay((Uint32)((timeUs - nowUs) / 1000) - 1);
+    }
+
+    while (StreamUtils::getMicroseconds() < timeUs);
+}
+
+// A display refreshing at exactly its nominal rate
+class SimulatedDisplay
+{
+public:
+    SimulatedDisplay(int displayFps)
+        : m_StartTimeUs(StreamUtils::getMicroseconds()),
+          m_PeriodUs(1000000.0 / displayFps)
+    {
+    }
+
+    Uint64 getNextVsyncTime(Uint64 timeUs)
+    {
+        double periods = SDL_floor((timeUs - m_StartTimeUs) / m_PeriodUs) + 1;
+        return m_StartTimeUs + (Uint64)(periods * m_PeriodUs);
+    }
+
+    double getPeriodUs()
+    {
+        return m_PeriodUs;
+    }
+
+private:
+    Uint64 m_StartTimeUs;
+    double m_PeriodUs;
+};
+
+class SimulatedVsyncSource : public IVsyncSource
+{
+public:
+    SimulatedVsyncSource(Pacer* pacer, SimulatedDisplay* display)
+        : m_Pacer(pacer),
+          m_Display(display),
+          m_Thread(nullptr)
+    {
+        SDL_AtomicSet(&m_Stopping, 0);
+    }
+
+    virtual ~SimulatedVsyncSource()
+    {
+        if (m_Thread != nullptr) {
+            SDL_AtomicSet(&m_Stopping, 1);
+            SDL_WaitThread(m_Thread, nullptr);
+        }
+    }
+
+    virtual bool initialize(SDL_Window*, int)
+    {
+        m_Thread = SDL_CreateThread(vsyncThread, "SimulatedVsync", this);
+        if (m_Thread == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Unable to create simulated V-sync thread: %s",
+                         SDL_GetError());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    static int vsyncThread(void* context)
+    {
+        SimulatedVsyncSource* me = reinterpret_cast<SimulatedVsyncSource*>(context);
+
+        while (SDL_AtomicGet(&me->m_Stopping) == 0) {
+            Uint64 vsyncTimeUs = me->m_Display->getNextVsyncTime(StreamUtils::getMicroseconds());
+            sleepUntil(vsyncTimeUs);
+
+            Uint64 nextVsyncTimeUs = me->m_Display->getNextVsyncTime(vsyncTimeUs + 1);
+            me->m_Pacer->vsyncCallback((int)((nextVsyncTimeUs - StreamUtils::getMicroseconds()) / 1000));
+        }
+
+        return 0;
+    }
+
+    Pacer* m_Pacer;
+    SimulatedDisplay* m_Display;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+};
+
+// Discards frames like a swap that waits for V-sync, and records when
+// each frame would have been on screen.
+class SimulatedRenderer : public IFFmpegRenderer
+{
+public:
+    SimulatedRenderer(SimulatedDisplay* display)
+        : m_Display(display),
+          m_SwapStartTimeUs(0),
+          m_PresentTimeUs(0),
+          m_DisplayedFrames(0),
+          m_RepeatedVsyncs(0)
+    {
+        m_DisplayLatency.reset();
+        m_DisplayInterval.reset();
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS)
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**)
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame* frame)
+    {
+        if (frame == nullptr) {
+            // End of stream
+            return;
+        }
+
+        Uint64 lastPresentTimeUs = m_PresentTimeUs;
+
+        m_SwapStartTimeUs = StreamUtils::getMicroseconds();
+        m_PresentTimeUs = m_Display->getNextVsyncTime(m_SwapStartTimeUs);
+        sleepUntil(m_PresentTimeUs);
+
+        if (frame->opaque_ref != nullptr) {
+            m_DisplayLatency.record(m_PresentTimeUs - ((PFRAME_TIMESTAMPS)frame->opaque_ref->data)->decodeEndTimeUs);
+        }
+
+        if (lastPresentTimeUs != 0) {
+            Uint64 intervalUs = m_PresentTimeUs - lastPresentTimeUs;
+            m_DisplayInterval.record(intervalUs);
+            m_RepeatedVsyncs += (int)SDL_floor(intervalUs / m_Display->getPeriodUs() + 0.5) - 1;
+        }
+
+        m_DisplayedFrames++;
+    }
+
+    virtual void getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs)
+    {
+        *swapStartTimeUs = m_SwapStartTimeUs;
+        *presentTimeUs = m_PresentTimeUs;
+    }
+
+    // Only read after Pacer has stopped the render thread
+    LatencyHistogram m_DisplayLatency;
+    LatencyHistogram m_DisplayInterval;
+    int m_DisplayedFrames;
+    int m_RepeatedVsyncs;
+
+private:
+    SimulatedDisplay* m_Display;
+    Uint64 m_SwapStartTimeUs;
+    Uint64 m_PresentTimeUs;
+};
+
+static const char* getPatternName(ArrivalPattern pattern)
+{
+    switch (pattern) {
+    case AP_CONSTANT:
+        return "constant";
+    case AP_JITTER:
+        return "jitter";
+    case AP_BURST:
+        return "burst";
+    case AP_STALL:
+        return "stall";
+    case AP_DRIFT:
+        return "drift";
+    default:
+        return "unknown";
+    }
+}
+
+static const char* getPolicyName(int policy)
+{
+    switch (policy) {
+    case PACING_POLICY_IMMEDIATE:
+        return "immediate";
+    case PACING_POLICY_QUEUE:
+        return "queue";
+    case PACING_POLICY_PTS:
+        return "pts";
+    default:
+        return "unknown";
+    }
+}
+
+Benchmark::Benchmark(const BENCH_PARAMETERS& params)
+    : m_Params(params),
+      m_Pacer(nullptr),
+      m_StartTimeUs(0),
+      m_SubmittedFrames(0)
+{
+    if (m_Params.magnitudeMs == 0) {
+        switch (m_Params.pattern) {
+        case AP_JITTER:
+            m_Params.magnitudeMs = DEFAULT_JITTER_MS;
+            break;
+        case AP_BURST:
+            m_Params.magnitudeMs = DEFAULT_BURST_HOLD_MS;
+            break;
+        case AP_STALL:
+            m_Params.magnitudeMs = DEFAULT_STALL_MS;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (m_Params.driftPpm == 0 && m_Params.pattern == AP_DRIFT) {
+        m_Params.driftPpm = DEFAULT_DRIFT_PPM;
+    }
+}
+
+void Benchmark::generateArrivals()
+{
+    // Use the same arrivals for every policy and every run
+    double magnitudeUs = m_Params.magnitudeMs * 1000.0;
+    std::mt19937 engine(1);
+    std::normal_distribution<double> jitter(0, SDL_max(magnitudeUs, 1.0));
+
+    double driftRatio = 1 + m_Params.driftPpm / 1000000.0;
+    int frameCount = m_Params.streamFps * m_Params.durationSecs;
+    Uint64 lastArrivalTimeUs = 0;
+
+    m_PtsMs.clear();
+    m_ArrivalTimesUs.clear();
+
+    for (int i = 0; i < frameCount; i++) {
+        double hostTimeUs = i * 1000000.0 / m_Params.streamFps;
+        double arrivalTimeUs = hostTimeUs * driftRatio;
+
+        switch (m_Params.pattern) {
+        case AP_JITTER:
+            // Offset by 3 deviations so few frames would need to arrive early
+            arrivalTimeUs += SDL_max(3 * magnitudeUs + jitter(engine), 0.0);
+            break;
+        case AP_BURST:
+        case AP_STALL:
+        {
+            // Frames due near the end of each interval are held until its end
+            double intervalUs = (m_Params.pattern == AP_BURST ? BURST_INTERVAL_MS : STALL_INTERVAL_MS) * 1000.0;
+            double offsetUs = SDL_fmod(arrivalTimeUs, intervalUs);
+            if (offsetUs > intervalUs - magnitudeUs) {
+                arrivalTimeUs += intervalUs - offsetUs;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        // Frames are always delivered in order
+        lastArrivalTimeUs = SDL_max((Uint64)arrivalTimeUs, lastArrivalTimeUs);
+
+        m_PtsMs.append((Sint64)(hostTimeUs / 1000));
+        m_ArrivalTimesUs.append(lastArrivalTimeUs);
+    }
+}
+
+int Benchmark::feederThread(void* context)
+{
+    Benchmark* me = reinterpret_cast<Benchmark*>(context);
+
+    for (int i = 0; i < me->m_ArrivalTimesUs.size(); i++) {
+        sleepUntil(me->m_StartTimeUs + me->m_ArrivalTimesUs[i]);
+
+        AVFrame* frame = av_frame_alloc();
+        if (frame == nullptr) {
+            break;
+        }
+
+        frame->pts = me->m_PtsMs[i];
+        frame->opaque_ref = av_buffer_allocz(sizeof(FRAME_TIMESTAMPS));
+        if (frame->opaque_ref != nullptr) {
+            PFRAME_TIMESTAMPS timestamps = (PFRAME_TIMESTAMPS)frame->opaque_ref->data;
+            timestamps->receiveTimeUs = timestamps->decodeStartTimeUs =
+                    timestamps->decodeEndTimeUs = StreamUtils::getMicroseconds();
+            timestamps->frameNumber = i;
+        }
+
+        me->m_Pacer->submitFrame(frame);
+        me->m_SubmittedFrames++;
+    }
+
+    return 0;
+}
+
+bool Benchmark::runPolicy(int policy)
+{
+    // Pacer picks this up in initialize()
+    qputenv("PTS_PACING", policy == PACING_POLICY_PTS ? "1" : "0");
+
+    VideoStatsShard renderStats, vsyncStats;
+    SimulatedDisplay display(m_Params.displayFps);
+    SimulatedRenderer renderer(&display);
+
+    m_Pacer = new Pacer(&renderer, &renderStats, &vsyncStats);
+    m_Pacer->setSimulatedDisplay(new SimulatedVsyncSource(m_Pacer, &display), m_Params.displayFps);
+    if (!m_Pacer->initialize(nullptr, m_Params.streamFps, policy != PACING_POLICY_IMMEDIATE)) {
+        delete m_Pacer;
+        m_Pacer = nullptr;
+        return false;
+    }
+
+    m_SubmittedFrames = 0;
+    m_StartTimeUs = StreamUtils::getMicroseconds();
+
+    SDL_Thread* thread = SDL_CreateThread(feederThread, "PacerBenchFeeder", this);
+    if (thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create feeder thread: %s",
+                     SDL_GetError());
+        delete m_Pacer;
+        m_Pacer = nullptr;
+        return false;
+    }
+
+    SDL_WaitThread(thread, nullptr);
+
+    // Give the last frames time to make it through the queues
+    SDL_Delay(MAX_QUEUED_FRAMES * 1000 / m_Params.displayFps + 100);
+
+    int driftPpm;
+    bool driftKnown = m_Pacer->getClockDriftPpm(&driftPpm);
+
+    // This stops the V-sync and render threads
+    delete m_Pacer;
+    m_Pacer = nullptr;
+
+    VIDEO_STATS stats;
+    SDL_zero(stats);
+    renderStats.collect(stats);
+    vsyncStats.collect(stats);
+
+    fprintf(stdout,
+            "%-10s %7d %7d %7d %7d %7d %7d %6.1f/%5.1f/%5.1f/%5.1f %6.1f %8.2f",
+            getPolicyName(policy),
+            (int)m_ArrivalTimesUs.size(),
+            renderer.m_DisplayedFrames,
+            m_SubmittedFrames - renderer.m_DisplayedFrames - (int)stats.cadenceSkippedFrames,
+            (int)stats.cadenceSkippedFrames,
+            (int)stats.pacerHeldFrames,
+            renderer.m_RepeatedVsyncs,
+            renderer.m_DisplayLatency.getPercentileMs(50),
+            renderer.m_DisplayLatency.getPercentileMs(95),
+            renderer.m_DisplayLatency.getPercentileMs(99),
+            renderer.m_DisplayLatency.getMaxMs(),
+            stats.pacerTime.getPercentileMs(99),
+            renderer.m_DisplayInterval.getStdDevMs());
+    if (driftKnown) {
+        fprintf(stdout, " %9d", driftPpm);
+    }
+    fprintf(stdout, "\n");
+    fflush(stdout);
+
+    return true;
+}
+
+int Benchmark::exec()
+{
+    generateArrivals();
+
+    fprintf(stdout,
+            "Pattern %s (%d ms) with %d ppm host drift: %d FPS stream on %d Hz display for %d seconds\n\n",
+            getPatternName(m_Params.pattern),
+            m_Params.magnitudeMs,
+            m_Params.driftPpm,
+            m_Params.streamFps,
+            m_Params.displayFps,
+            m_Params.durationSecs);
+    fprintf(stdout,
+            "%-10s %7s %7s %7s %7s %7s %7s %-26s %6s %8s %9s\n",
+            "Policy", "Frames", "Shown", "Dropped", "Skipped", "Held", "Repeats",
+            "Latency p50/p95/p99/max", "Queue", "Std dev", "Drift ppm");
+
+    static const int k_Policies[] = { PACING_POLICY_IMMEDIATE, PACING_POLICY_QUEUE, PACING_POLICY_PTS };
+    for (int policy : k_Policies) {
+        if ((m_Params.policies & policy) && !runPolicy(policy)) {
+            return 1;
+        }
+    }
+
+    fprintf(stdout,
+            "\nLatency is from frame arrival to display and Queue is p99 time in Pacer's\n"
+            "queues, both in ms. Std dev is of the time between displayed frames.\n"
+            "Skipped frames were left out of the display cadence by Pacer.\n");
+
+    return 0;
+}
+
+}
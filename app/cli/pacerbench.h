@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QVector>
+
+#include <SDL.h>
+
+class Pacer;
+
+namespace CliPacerBench
+{
+
+enum ArrivalPattern {
+    AP_CONSTANT,
+    AP_JITTER,
+    AP_BURST,
+    AP_STALL,
+    AP_DRIFT,
+};
+
+#define PACING_POLICY_IMMEDIATE 0x1
+#define PACING_POLICY_QUEUE     0x2
+#define PACING_POLICY_PTS       0x4
+#define PACING_POLICY_ALL       (PACING_POLICY_IMMEDIATE | PACING_POLICY_QUEUE | PACING_POLICY_PTS)
+
+typedef struct _BENCH_PARAMETERS {
+    ArrivalPattern pattern;
+    int streamFps;
+    int displayFps;
+    int durationSecs;
+
+    // Jitter standard deviation, burst hold time or stall length,
+    // depending on the pattern. Zero picks a default for the pattern.
+    int magnitudeMs;
+
+    // How far the host clock runs from ours. The drift
+    // pattern picks a default if this is zero.
+    int driftPpm;
+
+    // PACING_POLICY_* flags
+    int policies;
+} BENCH_PARAMETERS, *PBENCH_PARAMETERS;
+
+// Drives Pacer with synthetic frame arrivals against a simulated display,
+// so the pacing policies can be compared and tuned without a host or TV.
+// The simulation runs in real time, since Pacer waits on real clocks.
+class Benchmark
+{
+public:
+    Benchmark(const BENCH_PARAMETERS& params);
+
+    int exec();
+
+private:
+    void generateArrivals();
+
+    bool runPolicy(int policy);
+
+    static int feederThread(void* context);
+
+    BENCH_PARAMETERS m_Params;
+
+    // For each stream frame, its host presentation time and
+    // when it's ready for Pacer relative to the start of the run
+    QVector<Sint64> m_PtsMs;
+    QVector<Uint64> m_ArrivalTimesUs;
+
+    Pacer* m_Pacer;
+    Uint64 m_StartTimeUs;
+    int m_SubmittedFrames;
+};
+
+}
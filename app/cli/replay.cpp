@@ -0,0 +1,170 @@
+#include "replay.h"
+
+#include "settings/streamingpreferences.h"
+#include "streaming/session.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/videostats.h"
+
+namespace CliReplay
+{
+
+Replayer::Replayer(QString fileName, StreamingPreferences* preferences, bool maxSpeed)
+    : m_FileName(fileName),
+      m_Preferences(preferences),
+      m_MaxSpeed(maxSpeed),
+      m_Decoder(nullptr),
+      m_SubmittedFrames(0),
+      m_IdrRequests(0),
+      m_FeedStartTime(0),
+      m_FeedEndTime(0)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+int Replayer::feederThread(void* context)
+{
+    Replayer* me = reinterpret_cast<Replayer*>(context);
+    uint64_t firstReceiveTimeMs = 0;
+
+    me->m_FeedStartTime = SDL_GetTicks();
+
+    PDECODE_UNIT du;
+    while (SDL_AtomicGet(&me->m_Stopping) == 0 && (du = me->m_Reader.readNext()) != nullptr) {
+        if (du->bufferList == nullptr) {
+            continue;
+        }
+
+        if (!me->m_MaxSpeed) {
+            // Wait until this frame would have arrived from the host
+            if (firstReceiveTimeMs == 0) {
+                firstReceiveTimeMs = du->receiveTimeMs;
+            }
+
+            Uint32 dueTime = me->m_FeedStartTime + (Uint32)(du->receiveTimeMs - firstReceiveTimeMs);
+            while (!SDL_TICKS_PASSED(SDL_GetTicks(), dueTime) && SDL_AtomicGet(&me->m_Stopping) == 0) {
+                SDL_Delay(1);
+            }
+        }
+
+        // The frame is fully reassembled as of now
+        du->receiveTimeMs = LiGetMillis();
+
+        // We can't produce a new IDR frame, so all we can do is count these
+        if (me->m_Decoder->submitDecodeUnit(du) == DR_NEED_IDR) {
+            me->m_IdrRequests++;
+        }
+
+        me->m_SubmittedFrames++;
+    }
+
+    me->m_FeedEndTime = SDL_GetTicks();
+
+    // Wake the main thread so it can finish up
+    SDL_Event event;
+    event.type = SDL_QUIT;
+    SDL_PushEvent(&event);
+
+    return 0;
+}
+
+int Replayer::exec()
+{
+    if (!m_Reader.open(m_FileName)) {
+        return 1;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Replaying %dx%dx%d stream (format 0x%x) %s",
+                m_Reader.getWidth(),
+                m_Reader.getHeight(),
+                m_Reader.getFrameRate(),
+                m_Reader.getVideoFormat(),
+                m_MaxSpeed ? "at maximum speed" : "with recorded timing");
+
+    if (m_MaxSpeed && !qEnvironmentVariableIsSet("DECODE_THREAD")) {
+        // Submitting faster than the decoder thread can keep up would just
+        // drop frames until an IDR frame that will never come.
+        qputenv("DECODE_THREAD", "0");
+    }
+
+    SDL_Window* window = SDL_CreateWindow("Moonlight Replay",
+                                          SDL_WINDOWPOS_UNDEFINED,
+                                          SDL_WINDOWPOS_UNDEFINED,
+                                          m_Reader.getWidth(),
+                                          m_Reader.getHeight(),
+                                          StreamUtils::getPlatformWindowFlags());
+    if (window == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateWindow() failed: %s",
+                     SDL_GetError());
+        return 1;
+    }
+
+    if (!Session::chooseDecoder(m_Preferences->videoDecoderSelection,
+                                window,
+                                m_Reader.getVideoFormat(),
+                                m_Reader.getWidth(),
+                                m_Reader.getHeight(),
+                                m_Reader.getFrameRate(),
+                                m_Preferences->enableVsync,
+                                m_Preferences->enableVsync && m_Preferences->framePacing,
+                                false,
+                                m_Decoder)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No decoder is available for the captured stream");
+        SDL_DestroyWindow(window);
+        return 1;
+    }
+
+    SDL_Thread* thread = SDL_CreateThread(feederThread, "Replay", this);
+    if (thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create replay thread: %s",
+                     SDL_GetError());
+        delete m_Decoder;
+        SDL_DestroyWindow(window);
+        return 1;
+    }
+
+    SDL_Event event;
+    while (SDL_WaitEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            break;
+        }
+        else if (event.type == SDL_USEREVENT && event.user.code == SDL_CODE_FRAME_READY) {
+            m_Decoder->renderFrameOnMainThread();
+        }
+    }
+
+    SDL_AtomicSet(&m_Stopping, 1);
+    SDL_WaitThread(thread, nullptr);
+
+    VIDEO_STATS stats;
+    m_Decoder->getFinalVideoStats(stats);
+
+    delete m_Decoder;
+    m_Decoder = nullptr;
+
+    SDL_DestroyWindow(window);
+
+    Uint32 elapsedMs = m_FeedEndTime - m_FeedStartTime;
+    fprintf(stdout,
+            "Replayed %d frames in %.2f seconds (%.2f FPS), %d IDR frames requested\n",
+            m_SubmittedFrames,
+            elapsedMs / 1000.0f,
+            elapsedMs > 0 ? m_SubmittedFrames * 1000.0f / elapsedMs : 0.0f,
+            m_IdrRequests);
+
+    // The same summary the performance overlay shows
+    char statsText[2048];
+    VideoStats::stringify(stats,
+                          m_Reader.getVideoFormat(),
+                          m_Reader.getWidth(),
+                          m_Reader.getHeight(),
+                          statsText);
+    fputs(statsText, stdout);
+
+    return 0;
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+
+#include <SDL.h>
+
+#include "streaming/video/decodeunitcapture.h"
+
+class IVideoDecoder;
+class StreamingPreferences;
+
+namespace CliReplay
+{
+
+// Feeds a decode unit capture into a video decoder without a host, so
+// decode and render performance can be measured repeatably.
+class Replayer
+{
+public:
+    Replayer(QString fileName, StreamingPreferences* preferences, bool maxSpeed);
+
+    int exec();
+
+private:
+    static int feederThread(void* context);
+
+    QString m_FileName;
+    StreamingPreferences* m_Preferences;
+    bool m_MaxSpeed;
+
+    DecodeUnitReader m_Reader;
+    IVideoDecoder* m_Decoder;
+    SDL_atomic_t m_Stopping;
+    int m_SubmittedFrames;
+    int m_IdrRequests;
+    Uint32 m_FeedStartTime;
+    Uint32 m_FeedEndTime;
+};
+
+}
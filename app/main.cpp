@@ -36,7 +36,10 @@
 #include <openssl/ssl.h>
 #endif
 
+#include "cli/copybench.h"
+#include "cli/pacerbench.h"
 #include "cli/quitstream.h"
+#include "cli/replay.h"
 #include "cli/startstream.h"
 #include "cli/commandlineparser.h"
 #include "path.h"
@@ -587,6 +590,36 @@ int main(int argc, char *argv[])
             engine.rootContext()->setContextProperty("launcher", launcher);
             break;
         }
+    case GlobalCommandLineParser::ReplayRequested:
+        {
+            // Replay runs to completion without any UI
+            StreamingPreferences* preferences = new StreamingPreferences(&app);
+            ReplayCommandLineParser replayParser;
+            replayParser.parse(app.arguments(), preferences);
+            CliReplay::Replayer replayer(replayParser.getFileName(), preferences, replayParser.isMaxSpeed());
+            return replayer.exec();
+        }
+    case GlobalCommandLineParser::PacerBenchRequested:
+        {
+            CliPacerBench::BENCH_PARAMETERS params;
+            PacerBenchCommandLineParser pacerBenchParser;
+            pacerBenchParser.parse(app.arguments(), &params);
+#ifdef HAVE_FFMPEG
+            CliPacerBench::Benchmark benchmark(params);
+            return benchmark.exec();
+#else
+            // Pacer is part of the FFmpeg decoder
+            fprintf(stderr, "Frame pacing isn't available in this build\n");
+            return 1;
+#endif
+        }
+    case GlobalCommandLineParser::CopyBenchRequested:
+        {
+            CopyBenchCommandLineParser copyBenchParser;
+            copyBenchParser.parse(app.arguments());
+            CliCopyBench::Benchmark benchmark(copyBenchParser.getIterations());
+            return benchmark.exec();
+        }
     }
 #else
     initialView = "qrc:/gui/webos/PcView.qml";
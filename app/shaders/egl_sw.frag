@@ -0,0 +1,51 @@
+#version 300 es
+precision highp float;
+out vec4 FragColor;
+
+in vec2 vTextCoord;
+
+uniform mat3 yuvmat;
+uniform vec3 offset;
+uniform sampler2D plane1;
+uniform sampler2D plane2;
+uniform sampler2D plane3;
+
+// Y, U and V planes rather than Y and interleaved UV
+uniform bool planar;
+
+// 16-bit samples are uploaded as pairs of bytes, so this scales
+// (low + 256 * high) back to [0, 1]. It's zero for 8-bit samples.
+uniform float wideScale;
+
+float wideSample(vec2 bytes) {
+	return (bytes.x + bytes.y * 256.0) * wideScale;
+}
+
+void main() {
+	vec3 YCbCr;
+
+	if (wideScale == 0.0) {
+		YCbCr.x = texture(plane1, vTextCoord).r;
+		if (planar) {
+			YCbCr.yz = vec2(texture(plane2, vTextCoord).r,
+			                texture(plane3, vTextCoord).r);
+		}
+		else {
+			YCbCr.yz = texture(plane2, vTextCoord).rg;
+		}
+	}
+	else {
+		YCbCr.x = wideSample(texture(plane1, vTextCoord).rg);
+		if (planar) {
+			YCbCr.yz = vec2(wideSample(texture(plane2, vTextCoord).rg),
+			                wideSample(texture(plane3, vTextCoord).rg));
+		}
+		else {
+			vec4 uv = texture(plane2, vTextCoord);
+			YCbCr.yz = vec2(wideSample(uv.rg), wideSample(uv.ba));
+		}
+	}
+
+	YCbCr -= offset;
+	FragColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0);
+}
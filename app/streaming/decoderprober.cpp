@@ -0,0 +1,83 @@
+#include "decoderprober.h"
+#include "session.h"
+
+// Don't let slow decoders stall the launch. Once probing has taken longer
+// than this, optional formats that haven't been probed yet are left unknown.
+#define PROBE_DEADLINE_MS 5000
+
+DecoderProber::DecoderProber(StreamingPreferences::VideoDecoderSelection vds,
+                             int width, int height, int frameRate)
+    : m_Vds(vds),
+      m_Width(width),
+      m_Height(height),
+      m_FrameRate(frameRate),
+      m_Deadline(SDL_GetTicks() + PROBE_DEADLINE_MS)
+{
+    SDL_zero(m_SkippedResult);
+    m_SkippedResult.skipped = true;
+}
+
+DecoderProber::~DecoderProber()
+{
+    for (Probe* probe : m_Probes) {
+        delete probe;
+    }
+}
+
+bool DecoderProber::isSupported()
+{
+    return !qEnvironmentVariableIsSet("DECODER_PROBER") ||
+            qEnvironmentVariableIntValue("DECODER_PROBER") != 0;
+}
+
+PDECODER_PROBE_RESULT DecoderProber::getResult(SDL_Window* window, int videoFormat,
+                                               int width, int height, int frameRate,
+                                               bool optional)
+{
+    if (width != m_Width || height != m_Height || frameRate != m_FrameRate) {
+        return nullptr;
+    }
+
+    for (Probe* probe : m_Probes) {
+        if (probe->videoFormat == videoFormat) {
+            return &probe->result;
+        }
+    }
+
+    if (optional && SDL_TICKS_PASSED(SDL_GetTicks(), m_Deadline)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Skipping decoder probe for format 0x%x after exceeding %d ms",
+                    videoFormat,
+                    PROBE_DEADLINE_MS);
+        return &m_SkippedResult;
+    }
+
+    Probe* probe = new Probe();
+    probe->videoFormat = videoFormat;
+    SDL_zero(probe->result);
+
+    Uint32 startTime = SDL_GetTicks();
+    IVideoDecoder* decoder;
+
+    if (Session::chooseDecoder(m_Vds, window, videoFormat,
+                               m_Width, m_Height, m_FrameRate,
+                               true, false, true, decoder)) {
+        probe->result.available = true;
+        probe->result.hardwareAccelerated = decoder->isHardwareAccelerated();
+        probe->result.capabilities = decoder->getDecoderCapabilities();
+        probe->result.colorspace = decoder->getDecoderColorspace();
+        delete decoder;
+    }
+
+    probe->duration = SDL_GetTicks() - startTime;
+    m_Probes.append(probe);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decoder probe for format 0x%x took %u ms (available: %d, hardware: %d)",
+                videoFormat,
+                probe->duration,
+                probe->result.available,
+                probe->result.hardwareAccelerated);
+
+    return &probe->result;
+}
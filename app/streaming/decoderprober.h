@@ -0,0 +1,54 @@
+#pragma once
+
+#include "settings/streamingpreferences.h"
+
+#include <SDL.h>
+
+#include <QVector>
+
+typedef struct _DECODER_PROBE_RESULT {
+    bool available;
+    bool hardwareAccelerated;
+    int capabilities;
+    int colorspace;
+
+    // The probe was skipped, so we don't know whether the format works
+    bool skipped;
+} DECODER_PROBE_RESULT, *PDECODER_PROBE_RESULT;
+
+// Caches the test-only decoder selection for each video format so the launch
+// checks don't create the same decoder several times, and stops speculative
+// probing once startup has spent too long on it. Probes run on the calling
+// thread, which must be the main thread since decoders create renderers.
+class DecoderProber
+{
+public:
+    DecoderProber(StreamingPreferences::VideoDecoderSelection vds,
+                  int width, int height, int frameRate);
+
+    ~DecoderProber();
+
+    // Probes this format on the given window unless a result is already cached.
+    // Once the probing budget is spent, optional probes are skipped and their
+    // result is marked as skipped rather than reporting the format unavailable. Returns nullptr if the parameters don't match the prober's.
+    PDECODER_PROBE_RESULT getResult(SDL_Window* window, int videoFormat,
+                                    int width, int height, int frameRate,
+                                    bool optional);
+
+    static bool isSupported();
+
+private:
+    struct Probe {
+        int videoFormat;
+        Uint32 duration;
+        DECODER_PROBE_RESULT result;
+    };
+
+    StreamingPreferences::VideoDecoderSelection m_Vds;
+    int m_Width;
+    int m_Height;
+    int m_FrameRate;
+    Uint32 m_Deadline;
+    DECODER_PROBE_RESULT m_SkippedResult;
+    QVector<Probe*> m_Probes;
+};
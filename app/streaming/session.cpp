@@ -1,6 +1,9 @@
 #include "session.h"
 #include "settings/streamingpreferences.h"
 #include "streaming/streamutils.h"
+#include "streaming/decoderprober.h"
+#include "streaming/video/frametrace.h"
+#include "path.h"
 #include "backend/richpresencemanager.h"
 
 #include <Limelight.h>
@@ -152,6 +155,10 @@ void Session::clConnectionStatusUpdate(int connectionStatus)
                 "Connection status update: %d",
                 connectionStatus);
 
+    if (s_ActiveSession->m_MetricsExporter != nullptr) {
+        s_ActiveSession->m_MetricsExporter->setConnectionStatus(connectionStatus);
+    }
+
     if (!s_ActiveSession->m_Preferences->connectionWarnings) {
         return;
     }
@@ -189,6 +196,7 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     params.height = height;
     params.frameRate = frameRate;
     params.videoFormat = videoFormat;
+    params.bitrate = s_ActiveSession != nullptr ? s_ActiveSession->m_StreamConfig.bitrate : 0;
     params.window = window;
     params.enableVsync = enableVsync;
     params.enableFramePacing = enableFramePacing;
@@ -265,9 +273,47 @@ int Session::drSetup(int videoFormat, int width, int height, int frameRate, void
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Video stream is %dx%dx%d (format 0x%x)",
                 width, height, frameRate, videoFormat);
 
+    // Record the incoming video stream for offline replay if requested
+    QString captureFile = qgetenv("DECODE_UNIT_CAPTURE");
+    if (!captureFile.isEmpty()) {
+        s_ActiveSession->m_DecodeUnitWriter = new DecodeUnitWriter();
+        if (!s_ActiveSession->m_DecodeUnitWriter->open(captureFile, videoFormat, width, height, frameRate)) {
+            delete s_ActiveSession->m_DecodeUnitWriter;
+            s_ActiveSession->m_DecodeUnitWriter = nullptr;
+        }
+    }
+
+    // Record a timeline of each frame for offline analysis if requested
+    if (qEnvironmentVariableIntValue("FRAME_TRACE") != 0) {
+        FrameTrace::start();
+    }
+
+    // Export per-second stream metrics for offline analysis if requested
+    if (qEnvironmentVariableIntValue("STREAM_METRICS") != 0) {
+        s_ActiveSession->m_MetricsExporter = new StreamMetricsExporter();
+        if (!s_ActiveSession->m_MetricsExporter->start()) {
+            delete s_ActiveSession->m_MetricsExporter;
+            s_ActiveSession->m_MetricsExporter = nullptr;
+        }
+    }
+
     return 0;
 }
 
+void Session::drCleanup()
+{
+    // The video stream has stopped, so nobody else can be using these.
+    // The decoder that submits metrics is destroyed before we get here.
+    delete s_ActiveSession->m_DecodeUnitWriter;
+    s_ActiveSession->m_DecodeUnitWriter = nullptr;
+
+    delete s_ActiveSession->m_MetricsExporter;
+    s_ActiveSession->m_MetricsExporter = nullptr;
+
+    QDir logDir(Path::getLogDir());
+    FrameTrace::stop(logDir.filePath(QString("Moonlight-Trace-%1.json").arg(QDateTime::currentSecsSinceEpoch())));
+}
+
 int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
 {
     // Use a lock since we'll be yanking this decoder out
@@ -278,6 +324,11 @@ int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
     // safely return DR_OK and wait for m_NeedsIdr to be set by
     // the decoder reinitialization code.
 
+    if (s_ActiveSession->m_DecodeUnitWriter != nullptr) {
+        // Capture everything we receive, even if the decoder isn't ready
+        s_ActiveSession->m_DecodeUnitWriter->write(du);
+    }
+
     if (SDL_AtomicTryLock(&s_ActiveSession->m_DecoderLock)) {
         if (s_ActiveSession->m_NeedsIdr) {
             // If we reset our decoder, we'll need to request an IDR frame
@@ -340,14 +391,62 @@ bool Session::isHardwareDecodeAvailable(SDL_Window* window,
     return ret;
 }
 
+bool Session::probeHardwareDecode(SDL_Window* testWindow, int videoFormat, bool assumeIfSkipped)
+{
+    if (m_DecoderProber != nullptr) {
+        PDECODER_PROBE_RESULT result = m_DecoderProber->getResult(testWindow,
+                                                                  videoFormat,
+                                                                  m_StreamConfig.width,
+                                                                  m_StreamConfig.height,
+                                                                  m_StreamConfig.fps,
+                                                                  true);
+        if (result != nullptr && result->skipped) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Hardware decoding support for format 0x%x is unknown; assuming %s",
+                        videoFormat,
+                        assumeIfSkipped ? "supported" : "unsupported");
+            return assumeIfSkipped;
+        }
+        else if (result != nullptr) {
+            return result->hardwareAccelerated;
+        }
+    }
+
+    return isHardwareDecodeAvailable(testWindow,
+                                     m_Preferences->videoDecoderSelection,
+                                     videoFormat,
+                                     m_StreamConfig.width,
+                                     m_StreamConfig.height,
+                                     m_StreamConfig.fps);
+}
+
 bool Session::populateDecoderProperties(SDL_Window* window)
 {
     IVideoDecoder* decoder;
+    int videoFormat = m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
+                           (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264);
+
+    if (m_DecoderProber != nullptr) {
+        PDECODER_PROBE_RESULT result = m_DecoderProber->getResult(window,
+                                                                  videoFormat,
+                                                                  m_StreamConfig.width,
+                                                                  m_StreamConfig.height,
+                                                                  m_StreamConfig.fps,
+                                                                  false);
+        if (result != nullptr) {
+            if (!result->available) {
+                return false;
+            }
+
+            m_VideoCallbacks.capabilities = result->capabilities;
+            m_StreamConfig.colorSpace = result->colorspace;
+            return true;
+        }
+    }
 
     if (!chooseDecoder(m_Preferences->videoDecoderSelection,
                        window,
-                       m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
-                            (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264),
+                       videoFormat,
                        m_StreamConfig.width,
                        m_StreamConfig.height,
                        m_StreamConfig.fps,
@@ -371,6 +470,9 @@ Session::Session(NvComputer* computer, NvApp& app, StreamingPreferences *prefere
       m_Window(nullptr),
       m_VideoDecoder(nullptr),
       m_DecoderLock(0),
+      m_DecodeUnitWriter(nullptr),
+      m_MetricsExporter(nullptr),
+      m_DecoderProber(nullptr),
       m_NeedsIdr(false),
       m_AudioDisabled(false),
       m_DisplayOriginX(0),
@@ -438,6 +540,7 @@ bool Session::initialize()
 
     LiInitializeVideoCallbacks(&m_VideoCallbacks);
     m_VideoCallbacks.setup = drSetup;
+    m_VideoCallbacks.cleanup = drCleanup;
     m_VideoCallbacks.submitDecodeUnit = drSubmitDecodeUnit;
 
     LiInitializeStreamConfiguration(&m_StreamConfig);
@@ -483,17 +586,22 @@ bool Session::initialize()
                 "Audio channel mask: %X",
                 CHANNEL_MASK_FROM_AUDIO_CONFIGURATION(m_StreamConfig.audioConfiguration));
 
+    if (DecoderProber::isSupported()) {
+        // Share decoder probes between the launch checks below rather than
+        // creating the same decoder several times
+        m_DecoderProber = new DecoderProber(m_Preferences->videoDecoderSelection,
+                                            m_StreamConfig.width,
+                                            m_StreamConfig.height,
+                                            m_StreamConfig.fps);
+    }
+
     switch (m_Preferences->videoCodecConfig)
     {
     case StreamingPreferences::VCC_AUTO:
         // TODO: Determine if HEVC is better depending on the decoder
+        // If the probe was skipped, stay on H.264 which every decoder handles
         m_StreamConfig.supportsHevc =
-                isHardwareDecodeAvailable(testWindow,
-                                          m_Preferences->videoDecoderSelection,
-                                          VIDEO_FORMAT_H265,
-                                          m_StreamConfig.width,
-                                          m_StreamConfig.height,
-                                          m_StreamConfig.fps);
+                probeHardwareDecode(testWindow, VIDEO_FORMAT_H265, false);
 #ifdef Q_OS_DARWIN
         {
             // Prior to GFE 3.11, GFE did not allow us to constrain
@@ -558,6 +666,9 @@ bool Session::initialize()
         ret = populateDecoderProperties(testWindow);
     }
 
+    delete m_DecoderProber;
+    m_DecoderProber = nullptr;
+
     SDL_DestroyWindow(testWindow);
 
     if (!ret) {
@@ -617,12 +728,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 
         if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_AUTO && // Force hardware decoding checked below
                 m_Preferences->videoCodecConfig != StreamingPreferences::VCC_AUTO && // Already checked in initialize()
-                !isHardwareDecodeAvailable(testWindow,
-                                           m_Preferences->videoDecoderSelection,
-                                           VIDEO_FORMAT_H265,
-                                           m_StreamConfig.width,
-                                           m_StreamConfig.height,
-                                           m_StreamConfig.fps)) {
+                !probeHardwareDecode(testWindow, VIDEO_FORMAT_H265, true)) {
             if (hevcForced) {
                 emitLaunchWarning(tr("Using software decoding due to your selection to force HEVC without GPU support. This may cause poor streaming performance."));
             }
@@ -658,12 +764,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
             emitLaunchWarning(tr("Your host PC GPU doesn't support HDR streaming. "
                                  "A GeForce GTX 1000-series (Pascal) or later GPU is required for HDR streaming."));
         }
-        else if (!isHardwareDecodeAvailable(testWindow,
-                                            m_Preferences->videoDecoderSelection,
-                                            VIDEO_FORMAT_H265_MAIN10,
-                                            m_StreamConfig.width,
-                                            m_StreamConfig.height,
-                                            m_StreamConfig.fps)) {
+        else if (!probeHardwareDecode(testWindow, VIDEO_FORMAT_H265_MAIN10, true)) {
             emitLaunchWarning(tr("This PC's GPU doesn't support HEVC Main10 decoding for HDR streaming."));
         }
         else {
@@ -721,12 +822,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 
     if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_FORCE_HARDWARE &&
             !m_StreamConfig.enableHdr && // HEVC Main10 was already checked for hardware decode support above
-            !isHardwareDecodeAvailable(testWindow,
-                                       m_Preferences->videoDecoderSelection,
-                                       m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264,
-                                       m_StreamConfig.width,
-                                       m_StreamConfig.height,
-                                       m_StreamConfig.fps)) {
+            !probeHardwareDecode(testWindow, m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264, true)) {
         if (m_Preferences->videoCodecConfig == StreamingPreferences::VCC_AUTO) {
             emit displayLaunchError(tr("Your selection to force hardware decoding cannot be satisfied due to missing hardware decoding support on this PC's GPU."));
         }
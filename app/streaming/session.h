@@ -9,6 +9,11 @@
 #include "video/decoder.h"
 #include "audio/renderers/renderer.h"
 #include "video/overlaymanager.h"
+#include "video/decodeunitcapture.h"
+#include "streammetrics.h"
+
+class DecoderProber;
+namespace CliReplay { class Replayer; }
 
 class Session : public QObject
 {
@@ -17,6 +22,8 @@ class Session : public QObject
     friend class SdlInputHandler;
     friend class DeferredSessionCleanupTask;
     friend class AsyncConnectionStartThread;
+    friend class CliReplay::Replayer;
+    friend class DecoderProber;
 
 public:
     explicit Session(NvComputer* computer, NvApp& app, StreamingPreferences *preferences = nullptr);
@@ -41,6 +48,12 @@ public:
         return m_OverlayManager;
     }
 
+    // Returns nullptr unless metrics export was requested
+    StreamMetricsExporter* getMetricsExporter()
+    {
+        return m_MetricsExporter;
+    }
+
 signals:
     void stageStarting(QString stage);
 
@@ -67,6 +80,9 @@ private:
 
     bool populateDecoderProperties(SDL_Window* window);
 
+    // Returns assumeIfSkipped if the prober ran out of time before this format
+    bool probeHardwareDecode(SDL_Window* testWindow, int videoFormat, bool assumeIfSkipped);
+
     IAudioRenderer* createAudioRenderer(const POPUS_MULTISTREAM_CONFIGURATION opusConfig);
 
     bool testAudio(int audioConfiguration);
@@ -141,6 +157,9 @@ private:
     SDL_Window* m_Window;
     IVideoDecoder* m_VideoDecoder;
     SDL_SpinLock m_DecoderLock;
+    DecodeUnitWriter* m_DecodeUnitWriter;
+    StreamMetricsExporter* m_MetricsExporter;
+    DecoderProber* m_DecoderProber;
     bool m_NeedsIdr;
     bool m_AudioDisabled;
     Uint32 m_FullScreenFlag;
@@ -0,0 +1,235 @@
+#include "streammetrics.h"
+#include "path.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+
+StreamMetricsExporter::StreamMetricsExporter()
+    : m_WriterThread(nullptr),
+      m_QueueSemaphore(nullptr),
+      m_DroppedRecords(0)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+    SDL_AtomicSet(&m_ConnectionStatus, CONN_STATUS_OKAY);
+}
+
+StreamMetricsExporter::~StreamMetricsExporter()
+{
+    if (m_WriterThread != nullptr) {
+        // The writer drains the queue before it exits
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_SemPost(m_QueueSemaphore);
+        SDL_WaitThread(m_WriterThread, nullptr);
+    }
+
+    if (m_QueueSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_QueueSemaphore);
+    }
+}
+
+bool StreamMetricsExporter::start()
+{
+    QDir logDir(Path::getLogDir());
+    m_File.setFileName(logDir.filePath(QString("Moonlight-Metrics-%1.jsonl").arg(QDateTime::currentSecsSinceEpoch())));
+    if (!m_File.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open stream metrics file %s: %s",
+                     qPrintable(m_File.fileName()),
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    m_QueueSemaphore = SDL_CreateSemaphore(0);
+    if (m_QueueSemaphore == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create stream metrics semaphore: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    m_WriterThread = SDL_CreateThread(writerThreadProc, "MetricsWriter", this);
+    if (m_WriterThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create stream metrics writer thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Exporting stream metrics to %s",
+                qPrintable(m_File.fileName()));
+    return true;
+}
+
+void StreamMetricsExporter::setConnectionStatus(int connectionStatus)
+{
+    SDL_AtomicSet(&m_ConnectionStatus, connectionStatus);
+}
+
+void StreamMetricsExporter::submitVideoStats(const VIDEO_STATS& stats, const char* decoderName, int videoFormat)
+{
+    if (m_WriterThread == nullptr) {
+        return;
+    }
+
+    if (m_Queue.size() == STREAM_METRICS_QUEUE_SIZE) {
+        // The writer is stuck on a slow disk. Report the gap in the next record.
+        m_DroppedRecords++;
+        return;
+    }
+
+    STREAM_METRICS_RECORD record;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    record.videoStats = stats;
+    SDL_strlcpy(record.decoderName, decoderName, sizeof(record.decoderName));
+    record.videoFormat = videoFormat;
+    record.audioPendingFrames = LiGetPendingAudioFrames();
+    record.audioPendingDurationMs = LiGetPendingAudioDuration();
+    record.connectionStatus = SDL_AtomicGet(&m_ConnectionStatus);
+    record.droppedRecords = m_DroppedRecords;
+    m_DroppedRecords = 0;
+
+    m_Queue.push(record);
+    SDL_SemPost(m_QueueSemaphore);
+}
+
+int StreamMetricsExporter::writerThreadProc(void* context)
+{
+    StreamMetricsExporter* me = reinterpret_cast<StreamMetricsExporter*>(context);
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    for (;;) {
+        SDL_SemWait(me->m_QueueSemaphore);
+
+        STREAM_METRICS_RECORD record;
+        while (me->m_Queue.pop(record)) {
+            me->writeRecord(record);
+        }
+
+        if (SDL_AtomicGet(&me->m_Stopping) != 0) {
+            break;
+        }
+    }
+
+    me->m_File.close();
+    return 0;
+}
+
+static QJsonObject latencyToJson(const LatencyHistogram& histogram)
+{
+    QJsonObject json;
+    json["avg"] = histogram.getAverageMs();
+    json["p50"] = histogram.getPercentileMs(50);
+    json["p95"] = histogram.getPercentileMs(95);
+    json["p99"] = histogram.getPercentileMs(99);
+    json["max"] = histogram.getMaxMs();
+    return json;
+}
+
+void StreamMetricsExporter::writeRecord(const STREAM_METRICS_RECORD& record)
+{
+    const VIDEO_STATS& stats = record.videoStats;
+    const char* codecString;
+
+    switch (record.videoFormat)
+    {
+    case VIDEO_FORMAT_H264:
+        codecString = "H.264";
+        break;
+    case VIDEO_FORMAT_H265:
+        codecString = "HEVC";
+        break;
+    case VIDEO_FORMAT_H265_MAIN10:
+        codecString = "HEVC Main 10";
+        break;
+    default:
+        codecString = "UNKNOWN";
+        break;
+    }
+
+    QJsonObject frames;
+    frames["total"] = (qint64)stats.totalFrames;
+    frames["received"] = (qint64)stats.receivedFrames;
+    frames["decoded"] = (qint64)stats.decodedFrames;
+    frames["rendered"] = (qint64)stats.renderedFrames;
+    frames["networkDropped"] = (qint64)stats.networkDroppedFrames;
+    frames["pacerDropped"] = (qint64)stats.pacerDroppedFrames;
+    frames["decodeQueueDropped"] = (qint64)stats.decodeQueueDroppedFrames;
+    frames["decoderDropped"] = (qint64)stats.decoderDroppedFrames;
+    frames["pacerHeld"] = (qint64)stats.pacerHeldFrames;
+    frames["cadenceSkipped"] = (qint64)stats.cadenceSkippedFrames;
+
+    QJsonObject frameTimeStdDev;
+    frameTimeStdDev["decoded"] = stats.decodedFrameInterval.getStdDevMs();
+    frameTimeStdDev["rendered"] = stats.renderedFrameInterval.getStdDevMs();
+
+    QJsonObject fps;
+    fps["total"] = stats.totalFps;
+    fps["received"] = stats.receivedFps;
+    fps["decoded"] = stats.decodedFps;
+    fps["rendered"] = stats.renderedFps;
+
+    QJsonObject latency;
+    latency["receive"] = latencyToJson(stats.reassemblyTime);
+    latency["decode"] = latencyToJson(stats.decodeTime);
+    latency["frameQueue"] = latencyToJson(stats.pacerTime);
+    latency["render"] = latencyToJson(stats.renderTime);
+
+    QJsonObject packets;
+    packets["bufferAllocations"] = (qint64)stats.packetBufferAllocations;
+    packets["copiedBytes"] = (qint64)stats.totalCopiedBytes;
+
+    static const char* k_RecoveryTierNames[DECODER_RECOVERY_TIERS] = { "flush", "recreate", "reset" };
+    QJsonObject recoveries;
+    for (int i = 0; i < DECODER_RECOVERY_TIERS; i++) {
+        if (stats.decoderRecoveries[i] != 0) {
+            QJsonObject tier;
+            tier["count"] = (qint64)stats.decoderRecoveries[i];
+            tier["totalTimeMs"] = (qint64)stats.totalDecoderRecoveryTime[i];
+            recoveries[k_RecoveryTierNames[i]] = tier;
+        }
+    }
+
+    QJsonObject audio;
+    audio["pendingFrames"] = record.audioPendingFrames;
+    audio["pendingDurationMs"] = record.audioPendingDurationMs;
+
+    QJsonObject json;
+    json["time"] = record.timestamp;
+    json["version"] = VERSION_STR;
+    json["kernel"] = QSysInfo::kernelVersion();
+    json["decoder"] = record.decoderName;
+    json["codec"] = codecString;
+    json["connection"] = record.connectionStatus == CONN_STATUS_POOR ? "poor" : "okay";
+    json["frames"] = frames;
+    json["fps"] = fps;
+    json["latencyMs"] = latency;
+    json["frameTimeStdDevMs"] = frameTimeStdDev;
+    json["packets"] = packets;
+    if (!recoveries.isEmpty()) {
+        json["decoderRecoveries"] = recoveries;
+    }
+    json["audio"] = audio;
+    if (stats.clockDriftKnown) {
+        json["clockDriftPpm"] = stats.clockDriftPpm;
+    }
+    if (record.droppedRecords != 0) {
+        json["droppedRecords"] = (qint64)record.droppedRecords;
+    }
+
+    QByteArray line = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    line.append('\n');
+
+    if (m_File.write(line) != line.size()) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to write stream metrics: %s",
+                    qPrintable(m_File.errorString()));
+    }
+
+    // Keep the file useful if we crash
+    m_File.flush();
+}
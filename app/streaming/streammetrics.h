@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QFile>
+
+#include "video/decoder.h"
+#include "video/spscring.h"
+
+// Must be a power of 2
+#define STREAM_METRICS_QUEUE_SIZE 4
+
+typedef struct _STREAM_METRICS_RECORD {
+    qint64 timestamp;
+    VIDEO_STATS videoStats;
+    char decoderName[32];
+    int videoFormat;
+    int audioPendingFrames;
+    int audioPendingDurationMs;
+    int connectionStatus;
+    Uint32 droppedRecords;
+} STREAM_METRICS_RECORD;
+
+// Appends one JSON object per line to a file in the log directory for each
+// stats window the decoder submits. Records are formatted and written on a
+// background thread, so submitting never touches the filesystem.
+class StreamMetricsExporter
+{
+public:
+    StreamMetricsExporter();
+    ~StreamMetricsExporter();
+
+    bool start();
+
+    // Only one thread at a time may submit stats
+    void submitVideoStats(const VIDEO_STATS& stats, const char* decoderName, int videoFormat);
+
+    void setConnectionStatus(int connectionStatus);
+
+private:
+    static int writerThreadProc(void* context);
+
+    void writeRecord(const STREAM_METRICS_RECORD& record);
+
+    QFile m_File;
+    SDL_Thread* m_WriterThread;
+    SDL_sem* m_QueueSemaphore;
+    SDL_atomic_t m_Stopping;
+    SDL_atomic_t m_ConnectionStatus;
+    SpscRing<STREAM_METRICS_RECORD, STREAM_METRICS_QUEUE_SIZE> m_Queue;
+    Uint32 m_DroppedRecords;
+};
@@ -132,3 +132,12 @@ bool StreamUtils::getRealDesktopMode(int displayIndex, SDL_DisplayMode* mode)
 
     return true;
 }
+
+Uint64 StreamUtils::getMicroseconds()
+{
+    static Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    // Split the conversion to avoid overflowing with high frequency counters
+    Uint64 counter = SDL_GetPerformanceCounter();
+    return (counter / frequency) * 1000000 + (counter % frequency) * 1000000 / frequency;
+}
@@ -16,4 +16,8 @@ public:
 
     static
     int getDisplayRefreshRate(SDL_Window* window);
+
+    // Monotonic clock for latency measurements
+    static
+    Uint64 getMicroseconds();
 };
@@ -3,11 +3,18 @@
 #include <Limelight.h>
 #include <SDL.h>
 #include "settings/streamingpreferences.h"
+#include "latencyhistogram.h"
 
 #define SDL_CODE_FRAME_READY 0
 
 #define MAX_SLICES 4
 
+// Steps taken in order to recover a decoder that keeps failing
+#define DECODER_RECOVERY_FLUSH 0
+#define DECODER_RECOVERY_RECREATE 1
+#define DECODER_RECOVERY_RESET 2
+#define DECODER_RECOVERY_TIERS 3
+
 typedef struct _VIDEO_STATS {
     uint32_t receivedFrames;
     uint32_t decodedFrames;
@@ -15,10 +22,23 @@ typedef struct _VIDEO_STATS {
     uint32_t totalFrames;
     uint32_t networkDroppedFrames;
     uint32_t pacerDroppedFrames;
-    uint32_t totalReassemblyTime;
-    uint32_t totalDecodeTime;
-    uint32_t totalPacerTime;
-    uint32_t totalRenderTime;
+    LatencyHistogram reassemblyTime;
+    LatencyHistogram decodeTime;
+    LatencyHistogram pacerTime;
+    LatencyHistogram renderTime;
+    LatencyHistogram decodedFrameInterval;
+    LatencyHistogram renderedFrameInterval;
+    uint32_t packetBufferAllocations;
+    uint64_t totalCopiedBytes;
+    uint32_t decodeQueueDroppedFrames;
+    uint32_t decoderDroppedFrames;
+    uint32_t totalDecodeQueueDepth;
+    uint32_t decoderRecoveries[DECODER_RECOVERY_TIERS];
+    uint32_t totalDecoderRecoveryTime[DECODER_RECOVERY_TIERS];
+    uint32_t pacerHeldFrames;
+    uint32_t cadenceSkippedFrames;
+    bool clockDriftKnown;
+    int clockDriftPpm;
     float totalFps;
     float receivedFps;
     float decodedFps;
@@ -34,6 +54,7 @@ typedef struct _DECODER_PARAMETERS {
     int width;
     int height;
     int frameRate;
+    int bitrate;
     bool enableVsync;
     bool enableFramePacing;
 } DECODER_PARAMETERS, *PDECODER_PARAMETERS;
@@ -49,4 +70,9 @@ public:
     virtual QSize getDecoderMaxResolution() = 0;
     virtual int submitDecodeUnit(PDECODE_UNIT du) = 0;
     virtual void renderFrameOnMainThread() = 0;
+
+    // Returns the stats of the whole stream, including the partial window
+    // since the last roll-up. The decoder may stop decoding to collect them,
+    // so this is only for once the last decode unit has been submitted.
+    virtual void getFinalVideoStats(VIDEO_STATS& stats) = 0;
 };
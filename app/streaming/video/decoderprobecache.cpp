@@ -0,0 +1,122 @@
+#include "decoderprobecache.h"
+#include "path.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <SDL.h>
+
+#define CACHE_FILE_NAME "decoderprobes.json"
+
+// Passing decoders are revalidated by every stream that uses them
+#define PASSED_ENTRY_LIFETIME_SECS (30 * 24 * 60 * 60)
+
+QMutex DecoderProbeCache::s_Lock;
+QMutex DecoderProbeCache::s_SaveLock;
+QJsonObject DecoderProbeCache::s_Entries;
+bool DecoderProbeCache::s_Loaded;
+bool DecoderProbeCache::s_SavePending;
+
+class DecoderProbeCacheSaveTask : public QRunnable
+{
+private:
+    virtual void run() override
+    {
+        DecoderProbeCache::save();
+    }
+};
+
+void DecoderProbeCache::load()
+{
+    if (s_Loaded) {
+        return;
+    }
+
+    s_Loaded = true;
+
+    QFile cacheFile(Path::getCacheFileInfo(CACHE_FILE_NAME).absoluteFilePath());
+    if (cacheFile.open(QIODevice::ReadOnly)) {
+        s_Entries = QJsonDocument::fromJson(cacheFile.readAll()).object();
+    }
+}
+
+// Must be called with s_Lock held
+void DecoderProbeCache::scheduleSave()
+{
+    // A save that hasn't started yet will pick up this change too
+    if (!s_SavePending) {
+        s_SavePending = true;
+        QThreadPool::globalInstance()->start(new DecoderProbeCacheSaveTask());
+    }
+}
+
+void DecoderProbeCache::save()
+{
+    // Keep saves in order, so an older snapshot never overwrites a newer one
+    QMutexLocker saveLock(&s_SaveLock);
+
+    QByteArray data;
+    {
+        QMutexLocker lock(&s_Lock);
+        s_SavePending = false;
+        data = QJsonDocument(s_Entries).toJson(QJsonDocument::Compact);
+    }
+
+    Path::writeCacheFile(CACHE_FILE_NAME, data);
+}
+
+DecoderProbeCache::ProbeResult DecoderProbeCache::lookup(QString key)
+{
+    QMutexLocker lock(&s_Lock);
+
+    load();
+
+    QJsonObject entry = s_Entries.value(key).toObject();
+    if (entry.isEmpty()) {
+        return ProbeUnknown;
+    }
+
+    // Failures written by older versions are retested
+    if (!entry.value("passed").toBool()) {
+        return ProbeUnknown;
+    }
+
+    qint64 age = QDateTime::currentSecsSinceEpoch() - (qint64)entry.value("time").toDouble();
+    if (age < 0 || age > PASSED_ENTRY_LIFETIME_SECS) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Cached decoder probe result has expired: %s",
+                    qPrintable(key));
+        return ProbeUnknown;
+    }
+
+    return ProbePassed;
+}
+
+void DecoderProbeCache::storePassed(QString key)
+{
+    QMutexLocker lock(&s_Lock);
+
+    load();
+
+    QJsonObject entry;
+    entry.insert("passed", true);
+    entry.insert("time", (double)QDateTime::currentSecsSinceEpoch());
+    s_Entries.insert(key, entry);
+
+    scheduleSave();
+}
+
+void DecoderProbeCache::remove(QString key)
+{
+    QMutexLocker lock(&s_Lock);
+
+    load();
+
+    if (s_Entries.contains(key)) {
+        s_Entries.remove(key);
+        scheduleSave();
+    }
+}
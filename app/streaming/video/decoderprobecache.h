@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+
+// Remembers decoders that passed their test frame across launches, so we
+// can skip the (sometimes very slow) test decode for decoders we've already
+// probed with the same software and driver versions. Failures aren't cached,
+// since they may be transient (device busy, driver hiccup) and a working
+// decoder shouldn't be skipped for them.
+class DecoderProbeCache
+{
+public:
+    enum ProbeResult {
+        ProbeUnknown,
+        ProbePassed,
+    };
+
+    static ProbeResult lookup(QString key);
+
+    static void storePassed(QString key);
+
+    static void remove(QString key);
+
+private:
+    friend class DecoderProbeCacheSaveTask;
+
+    static void load();
+
+    // The cache is written on a thread pool thread rather than
+    // on the decoder initialization and decoding paths
+    static void scheduleSave();
+
+    static void save();
+
+    static QMutex s_Lock;
+    static QMutex s_SaveLock;
+    static QJsonObject s_Entries;
+    static bool s_Loaded;
+    static bool s_SavePending;
+};
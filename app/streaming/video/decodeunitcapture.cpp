@@ -0,0 +1,313 @@
+#include "decodeunitcapture.h"
+
+#include <SDL.h>
+
+#pragma pack(push, 1)
+typedef struct _CAPTURE_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    int32_t videoFormat;
+    int32_t width;
+    int32_t height;
+    int32_t frameRate;
+} CAPTURE_HEADER;
+
+typedef struct _CAPTURE_DU_HEADER {
+    int32_t frameNumber;
+    int32_t frameType;
+    uint64_t receiveTimeMs;
+    uint32_t presentationTimeMs;
+    uint32_t entryCount;
+} CAPTURE_DU_HEADER;
+
+typedef struct _CAPTURE_ENTRY_HEADER {
+    int32_t bufferType;
+    uint32_t length;
+} CAPTURE_ENTRY_HEADER;
+#pragma pack(pop)
+
+DecodeUnitWriter::DecodeUnitWriter()
+    : m_Failed(false),
+      m_WriterThread(nullptr),
+      m_QueueSemaphore(nullptr)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+    SDL_AtomicSet(&m_WriteFailed, 0);
+}
+
+DecodeUnitWriter::~DecodeUnitWriter()
+{
+    close();
+}
+
+bool DecodeUnitWriter::open(QString fileName, int videoFormat, int width, int height, int frameRate)
+{
+    m_File.setFileName(fileName);
+    if (!m_File.open(QIODevice::WriteOnly)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open decode unit capture file %s: %s",
+                     qPrintable(fileName),
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    CAPTURE_HEADER header;
+    header.magic = DECODE_UNIT_CAPTURE_MAGIC;
+    header.version = DECODE_UNIT_CAPTURE_VERSION;
+    header.videoFormat = videoFormat;
+    header.width = width;
+    header.height = height;
+    header.frameRate = frameRate;
+
+    if (m_File.write((const char*)&header, sizeof(header)) != sizeof(header)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Decode unit capture failed: %s",
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    m_QueueSemaphore = SDL_CreateSemaphore(0);
+    if (m_QueueSemaphore == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode unit capture semaphore: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    m_WriterThread = SDL_CreateThread(writerThreadProc, "CaptureWriter", this);
+    if (m_WriterThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode unit capture thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Capturing decode units to %s",
+                qPrintable(fileName));
+    return true;
+}
+
+void DecodeUnitWriter::write(PDECODE_UNIT du)
+{
+    if (m_WriterThread == nullptr || m_Failed) {
+        return;
+    }
+
+    if (SDL_AtomicGet(&m_WriteFailed) != 0) {
+        // The writer thread already logged why
+        m_Failed = true;
+        return;
+    }
+
+    if (m_Queue.size() == DECODE_UNIT_CAPTURE_QUEUE_SIZE) {
+        // A capture with holes in it can't be decoded past the first one,
+        // so stop here rather than skipping frames.
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Decode unit capture can't keep up with the stream. Stopping capture.");
+        m_Failed = true;
+        return;
+    }
+
+    CAPTURE_DU_HEADER duHeader;
+    duHeader.frameNumber = du->frameNumber;
+    duHeader.frameType = du->frameType;
+    duHeader.receiveTimeMs = du->receiveTimeMs;
+    duHeader.presentationTimeMs = du->presentationTimeMs;
+    duHeader.entryCount = 0;
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        duHeader.entryCount++;
+    }
+
+    QByteArray* record = new QByteArray();
+    record->reserve(sizeof(duHeader) + duHeader.entryCount * sizeof(CAPTURE_ENTRY_HEADER) + du->fullLength);
+    record->append((const char*)&duHeader, sizeof(duHeader));
+
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        CAPTURE_ENTRY_HEADER entryHeader;
+        entryHeader.bufferType = entry->bufferType;
+        entryHeader.length = entry->length;
+
+        record->append((const char*)&entryHeader, sizeof(entryHeader));
+        record->append(entry->data, entry->length);
+    }
+
+    m_Queue.push(record);
+    SDL_SemPost(m_QueueSemaphore);
+}
+
+int DecodeUnitWriter::writerThreadProc(void* context)
+{
+    DecodeUnitWriter* me = reinterpret_cast<DecodeUnitWriter*>(context);
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    for (;;) {
+        SDL_SemWait(me->m_QueueSemaphore);
+
+        QByteArray* record;
+        while (me->m_Queue.pop(record)) {
+            if (SDL_AtomicGet(&me->m_WriteFailed) == 0 &&
+                    me->m_File.write(*record) != record->size()) {
+                // Don't keep trying (and logging) for every frame
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "Decode unit capture failed: %s",
+                             qPrintable(me->m_File.errorString()));
+                SDL_AtomicSet(&me->m_WriteFailed, 1);
+            }
+            delete record;
+        }
+
+        if (SDL_AtomicGet(&me->m_Stopping) != 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void DecodeUnitWriter::close()
+{
+    if (m_WriterThread != nullptr) {
+        // The writer drains the queue before it exits
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_SemPost(m_QueueSemaphore);
+        SDL_WaitThread(m_WriterThread, nullptr);
+        m_WriterThread = nullptr;
+    }
+
+    if (m_QueueSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_QueueSemaphore);
+        m_QueueSemaphore = nullptr;
+    }
+
+    if (m_File.isOpen()) {
+        m_File.close();
+    }
+}
+
+DecodeUnitReader::DecodeUnitReader()
+    : m_VideoFormat(0),
+      m_Width(0),
+      m_Height(0),
+      m_FrameRate(0)
+{
+    SDL_zero(m_DecodeUnit);
+}
+
+bool DecodeUnitReader::open(QString fileName)
+{
+    m_File.setFileName(fileName);
+    if (!m_File.open(QIODevice::ReadOnly)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open decode unit capture file %s: %s",
+                     qPrintable(fileName),
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    CAPTURE_HEADER header;
+    if (m_File.read((char*)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != DECODE_UNIT_CAPTURE_MAGIC) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "%s is not a decode unit capture file",
+                     qPrintable(fileName));
+        return false;
+    }
+
+    if (header.version != DECODE_UNIT_CAPTURE_VERSION) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unsupported decode unit capture version: %u",
+                     header.version);
+        return false;
+    }
+
+    m_VideoFormat = header.videoFormat;
+    m_Width = header.width;
+    m_Height = header.height;
+    m_FrameRate = header.frameRate;
+
+    return true;
+}
+
+int DecodeUnitReader::getVideoFormat()
+{
+    return m_VideoFormat;
+}
+
+int DecodeUnitReader::getWidth()
+{
+    return m_Width;
+}
+
+int DecodeUnitReader::getHeight()
+{
+    return m_Height;
+}
+
+int DecodeUnitReader::getFrameRate()
+{
+    return m_FrameRate;
+}
+
+PDECODE_UNIT DecodeUnitReader::readNext()
+{
+    CAPTURE_DU_HEADER duHeader;
+    if (m_File.read((char*)&duHeader, sizeof(duHeader)) != sizeof(duHeader)) {
+        return nullptr;
+    }
+
+    // Every entry needs at least its header, so a count that the rest of
+    // the file can't hold means it's truncated or corrupt.
+    if (duHeader.entryCount > (m_File.size() - m_File.pos()) / sizeof(CAPTURE_ENTRY_HEADER)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Corrupt decode unit capture file");
+        return nullptr;
+    }
+
+    m_Entries.resize(duHeader.entryCount);
+    m_Data.clear();
+
+    // Read all entry data first, since growing m_Data may move it
+    QVector<int> offsets(duHeader.entryCount);
+    for (uint32_t i = 0; i < duHeader.entryCount; i++) {
+        CAPTURE_ENTRY_HEADER entryHeader;
+        if (m_File.read((char*)&entryHeader, sizeof(entryHeader)) != sizeof(entryHeader)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Truncated decode unit capture file");
+            return nullptr;
+        }
+
+        if (entryHeader.length > m_File.size() - m_File.pos()) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Truncated decode unit capture file");
+            return nullptr;
+        }
+
+        offsets[i] = m_Data.size();
+        QByteArray data = m_File.read(entryHeader.length);
+        if (data.size() != (int)entryHeader.length) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Truncated decode unit capture file");
+            return nullptr;
+        }
+        m_Data.append(data);
+
+        m_Entries[i].bufferType = entryHeader.bufferType;
+        m_Entries[i].length = entryHeader.length;
+    }
+
+    for (uint32_t i = 0; i < duHeader.entryCount; i++) {
+        m_Entries[i].data = m_Data.data() + offsets[i];
+        m_Entries[i].next = i + 1 < duHeader.entryCount ? &m_Entries[i + 1] : nullptr;
+    }
+
+    m_DecodeUnit.frameNumber = duHeader.frameNumber;
+    m_DecodeUnit.frameType = duHeader.frameType;
+    m_DecodeUnit.receiveTimeMs = duHeader.receiveTimeMs;
+    m_DecodeUnit.presentationTimeMs = duHeader.presentationTimeMs;
+    m_DecodeUnit.fullLength = m_Data.size();
+    m_DecodeUnit.bufferList = duHeader.entryCount > 0 ? m_Entries.data() : nullptr;
+
+    return &m_DecodeUnit;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "spscring.h"
+
+#include <Limelight.h>
+
+#include <QFile>
+#include <QVector>
+
+// Decode unit capture files are a short header followed by a stream of
+// decode unit records in host byte order. Each record holds the decode
+// unit metadata followed by each of its buffer entries.
+#define DECODE_UNIT_CAPTURE_MAGIC 0x55444c4d // "MLDU"
+#define DECODE_UNIT_CAPTURE_VERSION 1
+
+// Must be a power of 2
+#define DECODE_UNIT_CAPTURE_QUEUE_SIZE 256
+
+// Records are serialized on the calling thread and written out on a
+// background thread, so capturing never blocks on the filesystem.
+class DecodeUnitWriter
+{
+public:
+    DecodeUnitWriter();
+    ~DecodeUnitWriter();
+
+    bool open(QString fileName, int videoFormat, int width, int height, int frameRate);
+
+    // Only one thread at a time may write decode units
+    void write(PDECODE_UNIT du);
+
+    void close();
+
+private:
+    static int writerThreadProc(void* context);
+
+    QFile m_File;
+    bool m_Failed;
+    SDL_Thread* m_WriterThread;
+    SDL_sem* m_QueueSemaphore;
+    SDL_atomic_t m_Stopping;
+    SDL_atomic_t m_WriteFailed;
+    SpscRing<QByteArray*, DECODE_UNIT_CAPTURE_QUEUE_SIZE> m_Queue;
+};
+
+class DecodeUnitReader
+{
+public:
+    DecodeUnitReader();
+
+    bool open(QString fileName);
+
+    int getVideoFormat();
+    int getWidth();
+    int getHeight();
+    int getFrameRate();
+
+    // Returns a decode unit that is valid until the next call,
+    // or nullptr at the end of the file.
+    PDECODE_UNIT readNext();
+
+private:
+    QFile m_File;
+    int m_VideoFormat;
+    int m_Width;
+    int m_Height;
+    int m_FrameRate;
+
+    DECODE_UNIT m_DecodeUnit;
+    QVector<LENTRY> m_Entries;
+    QByteArray m_Data;
+};
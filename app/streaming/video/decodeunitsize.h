@@ -0,0 +1,30 @@
+#pragma once
+
+#include <SDL.h>
+
+// Never go below this size, even for tiny or low bitrate streams
+#define MIN_DECODE_UNIT_BUFFER_SIZE (64 * 1024)
+
+// Key frames are several times larger than the average frame at a given bitrate
+#define KEY_FRAME_SIZE_FACTOR 4
+
+// Picks a buffer size that holds a key frame at the negotiated bitrate.
+// Shared by the FFmpeg packet pool and the webOS input pool, which may be
+// built without each other.
+static inline int getDecodeUnitBufferSize(int width, int height, int frameRate, int bitrateKbps)
+{
+    int bufferSize = MIN_DECODE_UNIT_BUFFER_SIZE;
+
+    if (bitrateKbps > 0 && frameRate > 0) {
+        // Leave room for a key frame at the negotiated bitrate
+        int averageFrameSize = (int)(((Sint64)bitrateKbps * 1000 / 8) / frameRate);
+        bufferSize = SDL_max(bufferSize, averageFrameSize * KEY_FRAME_SIZE_FACTOR);
+    }
+
+    if (width > 0 && height > 0) {
+        // A compressed frame will never reasonably exceed the uncompressed 4:2:0 size
+        bufferSize = SDL_min(bufferSize, SDL_max(MIN_DECODE_UNIT_BUFFER_SIZE, width * height * 3 / 2));
+    }
+
+    return bufferSize;
+}
@@ -4,6 +4,8 @@
 #include "path.h"
 #include "streaming/session.h"
 #include "streaming/streamutils.h"
+#include "streaming/video/frametrace.h"
+#include "streaming/video/planecopy.h"
 
 #include <QDir>
 
@@ -36,9 +38,37 @@ typedef EGLDisplay (EGLAPIENTRYP PFNEGLGETPLATFORMDISPLAYEXTPROC) (EGLenum platf
 #define EGL_PLATFORM_X11_KHR 0x31D5
 #endif
 
+// These are core in OpenGL ES 3.0, but SDL only provides the GLES2 headers
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+#ifndef GL_RG8
+#define GL_RG8 0x822B
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+
 /* TODO:
  *  - handle more pixel formats
- *  - handle software decoding
  */
 
 /* DOC/misc:
@@ -61,6 +91,97 @@ typedef EGLDisplay (EGLAPIENTRYP PFNEGLGETPLATFORMDISPLAYEXTPROC) (EGLenum platf
 
 SDL_Window* EGLRenderer::s_LastFailedWindow = nullptr;
 
+typedef struct _UPLOAD_PLANE {
+    int width;
+    int height;
+    int bytesPerTexel;
+    GLint internalFormat;
+    GLenum format;
+
+    // Where the plane goes in the pixel unpack buffer
+    int offset;
+    int pitch;
+} UPLOAD_PLANE;
+
+typedef struct _UPLOAD_LAYOUT {
+    int planeCount;
+    UPLOAD_PLANE planes[EGL_MAX_PLANES];
+    int bufferSize;
+
+    // See wideScale in egl_sw.frag
+    float wideScale;
+} UPLOAD_LAYOUT;
+
+static void addUploadPlane(UPLOAD_LAYOUT* layout, int width, int height, int bytesPerTexel)
+{
+    UPLOAD_PLANE* plane = &layout->planes[layout->planeCount++];
+
+    plane->width = width;
+    plane->height = height;
+    plane->bytesPerTexel = bytesPerTexel;
+
+    // 16-bit samples are uploaded as byte pairs, since OpenGL ES 3.0
+    // has no filterable 16-bit normalized formats
+    switch (bytesPerTexel) {
+    case 1:
+        plane->internalFormat = GL_R8;
+        plane->format = GL_RED;
+        break;
+    case 2:
+        plane->internalFormat = GL_RG8;
+        plane->format = GL_RG;
+        break;
+    default:
+        SDL_assert(bytesPerTexel == 4);
+        plane->internalFormat = GL_RGBA8;
+        plane->format = GL_RGBA;
+        break;
+    }
+
+    // Keep each line aligned for the plane copy
+    plane->offset = layout->bufferSize;
+    plane->pitch = FFALIGN(width * bytesPerTexel, 64);
+    layout->bufferSize += plane->pitch * height;
+}
+
+// Remember to keep this in sync with egl_sw.frag!
+static bool getUploadLayout(int format, int width, int height, UPLOAD_LAYOUT* layout)
+{
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+
+    SDL_zerop(layout);
+
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+        addUploadPlane(layout, width, height, 1);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 1);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 1);
+        break;
+    case AV_PIX_FMT_YUV420P10:
+        // 10 bits in the low bits of each sample
+        addUploadPlane(layout, width, height, 2);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 2);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 2);
+        layout->wideScale = 255.0f / 1023.0f;
+        break;
+    case AV_PIX_FMT_NV12:
+        addUploadPlane(layout, width, height, 1);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 2);
+        break;
+    case AV_PIX_FMT_P010:
+        // 10 bits in the high bits of each sample
+        addUploadPlane(layout, width, height, 2);
+        addUploadPlane(layout, chromaWidth, chromaHeight, 4);
+        layout->wideScale = 255.0f / 65535.0f;
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
 EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
     :
         m_SwPixelFormat(AV_PIX_FMT_NONE),
@@ -74,23 +195,57 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_ColorSpace(AVCOL_SPC_NB),
         m_ColorFull(false),
         m_BlockingSwapBuffers(false),
+        m_LastSwapStartTimeUs(0),
+        m_LastPresentTimeUs(0),
         m_glEGLImageTargetTexture2DOES(nullptr),
         m_glGenVertexArraysOES(nullptr),
         m_glBindVertexArrayOES(nullptr),
         m_glDeleteVertexArraysOES(nullptr),
+        m_UploadSlots{},
+        m_NextUploadSlot(0),
+        m_UploadFormat(AV_PIX_FMT_NONE),
+        m_UploadWidth(0),
+        m_UploadHeight(0),
+        m_glMapBufferRange(nullptr),
+        m_glUnmapBuffer(nullptr),
+        m_FenceDepth(-1),
+        m_FenceDisplay(EGL_NO_DISPLAY),
+        m_Fences{},
+        m_NextFence(0),
+        m_eglCreateSyncKHR(nullptr),
+        m_eglClientWaitSyncKHR(nullptr),
+        m_eglDestroySyncKHR(nullptr),
+        m_BlockedFenceWaits(0),
         m_DummyRenderer(nullptr)
 {
-    SDL_assert(backendRenderer);
-    SDL_assert(backendRenderer->canExportEGL());
+    SDL_assert(backendRenderer == nullptr || backendRenderer->canExportEGL());
 
     // Save these global parameters so we can restore them in our destructor
     SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &m_OldContextProfileMask);
     SDL_GL_GetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, &m_OldContextMajorVersion);
     SDL_GL_GetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, &m_OldContextMinorVersion);
+
+    m_FenceWaitTimes.reset();
 }
 
 EGLRenderer::~EGLRenderer()
 {
+    for (int i = 0; i <= EGL_MAX_FENCE_DEPTH; i++) {
+        if (m_Fences[i] != nullptr) {
+            m_eglDestroySyncKHR(m_FenceDisplay, m_Fences[i]);
+        }
+    }
+
+    if (m_FenceWaitTimes.getCount() > 0) {
+        EGL_LOG(Info, "Swap fence waits (depth %d): %u frames, %u blocked, average %.2f ms, p99 %.2f ms, max %.2f ms",
+                m_FenceDepth,
+                m_FenceWaitTimes.getCount(),
+                m_BlockedFenceWaits,
+                m_FenceWaitTimes.getAverageMs(),
+                m_FenceWaitTimes.getPercentileMs(99),
+                m_FenceWaitTimes.getMaxMs());
+    }
+
     if (m_Context) {
         // Reattach the GL context to the main thread for destruction
         SDL_GL_MakeCurrent(m_Window, m_Context);
@@ -101,6 +256,7 @@ EGLRenderer::~EGLRenderer()
             SDL_assert(m_glDeleteVertexArraysOES != nullptr);
             m_glDeleteVertexArraysOES(1, &m_VAO);
         }
+        freeUploadSlots();
         SDL_GL_DeleteContext(m_Context);
     }
 
@@ -130,8 +286,18 @@ void EGLRenderer::notifyOverlayUpdated(Overlay::OverlayType)
     // TODO: FIXME
 }
 
+bool EGLRenderer::isSoftwareUploadEnabled()
+{
+    return qEnvironmentVariableIntValue("EGL_SOFTWARE_UPLOAD") != 0;
+}
+
 bool EGLRenderer::isPixelFormatSupported(int, AVPixelFormat pixelFormat)
 {
+    if (m_Backend == nullptr) {
+        UPLOAD_LAYOUT layout;
+        return getUploadLayout(pixelFormat, 0, 0, &layout);
+    }
+
     // Remember to keep this in sync with EGLRenderer::renderFrame()!
     switch (pixelFormat)
     {
@@ -221,7 +387,7 @@ bool EGLRenderer::compileShader() {
     SDL_assert(m_SwPixelFormat != AV_PIX_FMT_NONE);
 
     // XXX: TODO: other formats
-    SDL_assert(m_SwPixelFormat == AV_PIX_FMT_NV12);
+    SDL_assert(m_Backend == nullptr || m_SwPixelFormat == AV_PIX_FMT_NV12);
 
     bool ret = false;
 
@@ -229,7 +395,9 @@ bool EGLRenderer::compileShader() {
     if (!vertexShader)
         return false;
 
-    GLuint fragmentShader = loadAndBuildShader(GL_FRAGMENT_SHADER, "egl.frag");
+    // Software frames are in regular textures rather than EGL images
+    GLuint fragmentShader = loadAndBuildShader(GL_FRAGMENT_SHADER,
+                                               m_Backend != nullptr ? "egl.frag" : "egl_sw.frag");
     if (!fragmentShader)
         goto fragError;
 
@@ -265,8 +433,8 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
 {
     m_Window = params->window;
 
-    if (params->videoFormat == VIDEO_FORMAT_H265_MAIN10) {
-        // EGL doesn't support rendering YUV 10-bit textures yet
+    if (params->videoFormat == VIDEO_FORMAT_H265_MAIN10 && m_Backend != nullptr) {
+        // EGL doesn't support rendering YUV 10-bit EGL images yet
         return false;
     }
 
@@ -363,24 +531,48 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
-    const EGLExtensions eglExtensions(m_EGLDisplay);
-    if (!eglExtensions.isSupported("EGL_KHR_image_base") &&
-        !eglExtensions.isSupported("EGL_KHR_image")) {
-        EGL_LOG(Error, "EGL_KHR_image unsupported");
-        return false;
-    }
-    else if (!SDL_GL_ExtensionSupported("GL_OES_EGL_image")) {
-        EGL_LOG(Error, "GL_OES_EGL_image unsupported");
-        return false;
+    if (m_Backend != nullptr) {
+        const EGLExtensions eglExtensions(m_EGLDisplay);
+        if (!eglExtensions.isSupported("EGL_KHR_image_base") &&
+            !eglExtensions.isSupported("EGL_KHR_image")) {
+            EGL_LOG(Error, "EGL_KHR_image unsupported");
+            return false;
+        }
+        else if (!SDL_GL_ExtensionSupported("GL_OES_EGL_image")) {
+            EGL_LOG(Error, "GL_OES_EGL_image unsupported");
+            return false;
+        }
+
+        if (!m_Backend->initializeEGL(m_EGLDisplay, eglExtensions))
+            return false;
+
+        if (!(m_glEGLImageTargetTexture2DOES = (typeof(m_glEGLImageTargetTexture2DOES))eglGetProcAddress("glEGLImageTargetTexture2DOES"))) {
+            EGL_LOG(Error,
+                    "EGL: cannot retrieve `glEGLImageTargetTexture2DOES` address");
+            return false;
+        }
     }
+    else {
+        // We upload software frames through pixel unpack buffers, which
+        // need OpenGL ES 3.0. Our shaders need it anyway.
+        int glesMajorVersion = 0;
+        const char* glVersion = (const char*)glGetString(GL_VERSION);
+        if (glVersion == nullptr ||
+                sscanf(glVersion, "OpenGL ES %d", &glesMajorVersion) != 1 ||
+                glesMajorVersion < 3) {
+            EGL_LOG(Error, "OpenGL ES 3.0 unsupported: %s", glVersion ? glVersion : "<null>");
+            return false;
+        }
 
-    if (!m_Backend->initializeEGL(m_EGLDisplay, eglExtensions))
-        return false;
+        m_glMapBufferRange = (typeof(m_glMapBufferRange))eglGetProcAddress("glMapBufferRange");
+        m_glUnmapBuffer = (typeof(m_glUnmapBuffer))eglGetProcAddress("glUnmapBuffer");
+        if (!m_glMapBufferRange || !m_glUnmapBuffer) {
+            EGL_LOG(Error, "Failed to find buffer mapping functions");
+            return false;
+        }
 
-    if (!(m_glEGLImageTargetTexture2DOES = (typeof(m_glEGLImageTargetTexture2DOES))eglGetProcAddress("glEGLImageTargetTexture2DOES"))) {
-        EGL_LOG(Error,
-                "EGL: cannot retrieve `glEGLImageTargetTexture2DOES` address");
-        return false;
+        EGL_LOG(Info, "Uploading software frames through %d pixel unpack buffers",
+                EGL_UPLOAD_RING_SIZE);
     }
 
     // Vertex arrays are an extension on OpenGL ES 2.0
@@ -419,19 +611,23 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
     if (params->enableVsync) {
         SDL_GL_SetSwapInterval(1);
         m_BlockingSwapBuffers = true;
+        initializeSwapFences();
     } else {
         SDL_GL_SetSwapInterval(0);
     }
 
     SDL_GL_SwapWindow(params->window);
 
-    glGenTextures(EGL_MAX_PLANES, m_Textures);
-    for (size_t i = 0; i < EGL_MAX_PLANES; ++i) {
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Textures for software frames are created once we know the frame size
+    if (m_Backend != nullptr) {
+        glGenTextures(EGL_MAX_PLANES, m_Textures);
+        for (size_t i = 0; i < EGL_MAX_PLANES; ++i) {
+            glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
     }
 
     GLenum err = glGetError();
@@ -444,6 +640,82 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
     return err == GL_NO_ERROR;
 }
 
+void EGLRenderer::initializeSwapFences()
+{
+    // The fences have to come from the display of SDL's context
+    m_FenceDisplay = eglGetCurrentDisplay();
+
+    const EGLExtensions eglExtensions(m_FenceDisplay);
+    if (!eglExtensions.isSupported("EGL_KHR_fence_sync") ||
+            !SDL_GL_ExtensionSupported("GL_OES_EGL_sync")) {
+        EGL_LOG(Info, "EGL_KHR_fence_sync unsupported. Waiting for buffer swaps with glFinish()");
+        return;
+    }
+
+    m_eglCreateSyncKHR = (typeof(m_eglCreateSyncKHR))eglGetProcAddress("eglCreateSyncKHR");
+    m_eglClientWaitSyncKHR = (typeof(m_eglClientWaitSyncKHR))eglGetProcAddress("eglClientWaitSyncKHR");
+    m_eglDestroySyncKHR = (typeof(m_eglDestroySyncKHR))eglGetProcAddress("eglDestroySyncKHR");
+    if (!m_eglCreateSyncKHR || !m_eglClientWaitSyncKHR || !m_eglDestroySyncKHR) {
+        EGL_LOG(Warn, "Failed to find fence functions. Waiting for buffer swaps with glFinish()");
+        return;
+    }
+
+    int depth = EGL_DEFAULT_FENCE_DEPTH;
+    if (qEnvironmentVariableIsSet("EGL_FENCE_DEPTH")) {
+        depth = qEnvironmentVariableIntValue("EGL_FENCE_DEPTH");
+    }
+    m_FenceDepth = SDL_max(0, SDL_min(depth, EGL_MAX_FENCE_DEPTH));
+
+    EGL_LOG(Info, "Waiting for buffer swaps with fences %d frame(s) deep", m_FenceDepth);
+}
+
+void EGLRenderer::waitForSwapFence()
+{
+    SDL_assert(m_FenceDepth >= 0);
+
+    EGLSyncKHR fence = m_eglCreateSyncKHR(m_FenceDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+    if (fence == EGL_NO_SYNC_KHR) {
+        EGL_LOG(Error, "eglCreateSyncKHR() failed: %d", eglGetError());
+        glFinish();
+        return;
+    }
+
+    // The fence we wait on is the oldest one, which is in the next slot
+    // we'll use. With a depth of zero, that's the one we just created.
+    SDL_assert(m_Fences[m_NextFence] == nullptr);
+    m_Fences[m_NextFence] = fence;
+    m_NextFence = (m_NextFence + 1) % (m_FenceDepth + 1);
+
+    fence = m_Fences[m_NextFence];
+    if (fence == nullptr) {
+        // We haven't rendered enough frames to fill the pipeline yet
+        return;
+    }
+    m_Fences[m_NextFence] = nullptr;
+
+    Uint64 waitStartTimeUs = StreamUtils::getMicroseconds();
+
+    // Poll first, so we know whether we actually had to block
+    EGLint status = m_eglClientWaitSyncKHR(m_FenceDisplay, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 0);
+    if (status == EGL_TIMEOUT_EXPIRED_KHR) {
+        status = m_eglClientWaitSyncKHR(m_FenceDisplay, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        if (status == EGL_CONDITION_SATISFIED_KHR) {
+            // The fence signaled when that frame's swap completed, so
+            // this is a V-sync even if it wasn't the current frame's
+            m_LastPresentTimeUs = StreamUtils::getMicroseconds();
+            m_BlockedFenceWaits++;
+        }
+    }
+
+    if (status == EGL_FALSE) {
+        EGL_LOG(Error, "eglClientWaitSyncKHR() failed: %d", eglGetError());
+    }
+
+    m_FenceWaitTimes.record(StreamUtils::getMicroseconds() - waitStartTimeUs);
+
+    m_eglDestroySyncKHR(m_FenceDisplay, fence);
+}
+
 const float *EGLRenderer::getColorMatrix() {
     /* The conversion matrices are shamelessly stolen from linux:
      * drivers/media/platform/imx-pxp.c:pxp_setup_csc
@@ -556,6 +828,10 @@ bool EGLRenderer::specialize() {
     glUniform1i(colorPlane, 0);
     colorPlane = glGetUniformLocation(m_ShaderProgram, "plane2");
     glUniform1i(colorPlane, 1);
+    if (m_Backend == nullptr) {
+        colorPlane = glGetUniformLocation(m_ShaderProgram, "plane3");
+        glUniform1i(colorPlane, 2);
+    }
 
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
@@ -568,10 +844,152 @@ bool EGLRenderer::specialize() {
     return err == GL_NO_ERROR;
 }
 
+void EGLRenderer::freeUploadSlots()
+{
+    for (int i = 0; i < EGL_UPLOAD_RING_SIZE; i++) {
+        if (m_UploadSlots[i].buffer != 0) {
+            glDeleteBuffers(1, &m_UploadSlots[i].buffer);
+        }
+        for (int j = 0; j < EGL_MAX_PLANES; j++) {
+            if (m_UploadSlots[i].textures[j] != 0) {
+                glDeleteTextures(1, &m_UploadSlots[i].textures[j]);
+            }
+        }
+    }
+
+    SDL_zero(m_UploadSlots);
+    m_NextUploadSlot = 0;
+    m_UploadFormat = AV_PIX_FMT_NONE;
+    m_UploadWidth = m_UploadHeight = 0;
+}
+
+bool EGLRenderer::allocateUploadSlots(AVFrame* frame)
+{
+    UPLOAD_LAYOUT layout;
+
+    freeUploadSlots();
+
+    if (!getUploadLayout(frame->format, frame->width, frame->height, &layout)) {
+        EGL_LOG(Error, "Unsupported software frame format: %d", frame->format);
+        return false;
+    }
+
+    for (int i = 0; i < EGL_UPLOAD_RING_SIZE; i++) {
+        // The textures keep their storage for the whole stream, so
+        // each upload only replaces their contents
+        glGenTextures(layout.planeCount, m_UploadSlots[i].textures);
+        for (int j = 0; j < layout.planeCount; j++) {
+            UPLOAD_PLANE* plane = &layout.planes[j];
+
+            glBindTexture(GL_TEXTURE_2D, m_UploadSlots[i].textures[j]);
+            glTexImage2D(GL_TEXTURE_2D, 0, plane->internalFormat,
+                         plane->width, plane->height, 0,
+                         plane->format, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glGenBuffers(1, &m_UploadSlots[i].buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_UploadSlots[i].buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, layout.bufferSize, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glUseProgram(m_ShaderProgram);
+    glUniform1i(glGetUniformLocation(m_ShaderProgram, "planar"), layout.planeCount == 3);
+    glUniform1f(glGetUniformLocation(m_ShaderProgram, "wideScale"), layout.wideScale);
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        EGL_LOG(Error, "OpenGL error: %d", err);
+        freeUploadSlots();
+        return false;
+    }
+
+    m_UploadFormat = frame->format;
+    m_UploadWidth = frame->width;
+    m_UploadHeight = frame->height;
+
+    EGL_LOG(Info, "Allocated %d upload buffers of %d bytes for %dx%d frames",
+            EGL_UPLOAD_RING_SIZE, layout.bufferSize, frame->width, frame->height);
+    return true;
+}
+
+bool EGLRenderer::uploadSoftwareFrame(AVFrame* frame)
+{
+    UPLOAD_LAYOUT layout;
+
+    if (frame->format != m_UploadFormat || frame->width != m_UploadWidth || frame->height != m_UploadHeight) {
+        if (!allocateUploadSlots(frame)) {
+            return false;
+        }
+    }
+
+    if (!getUploadLayout(frame->format, frame->width, frame->height, &layout)) {
+        SDL_assert(false);
+        return false;
+    }
+
+    UPLOAD_SLOT* slot = &m_UploadSlots[m_NextUploadSlot];
+    m_NextUploadSlot = (m_NextUploadSlot + 1) % EGL_UPLOAD_RING_SIZE;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+
+    // Invalidating the buffer lets the driver give us new storage rather
+    // than stalling if the GPU hasn't finished with the last upload yet
+    Uint8* data = (Uint8*)m_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, layout.bufferSize,
+                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (data == nullptr) {
+        EGL_LOG(Error, "glMapBufferRange() failed: %d", glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    {
+        FrameTrace::Span copySpan("Copy");
+
+        for (int i = 0; i < layout.planeCount; i++) {
+            UPLOAD_PLANE* plane = &layout.planes[i];
+
+            PlaneCopy::copyPlane(data + plane->offset, plane->pitch,
+                                 frame->data[i], frame->linesize[i],
+                                 plane->width * plane->bytesPerTexel, plane->height);
+        }
+    }
+
+    if (!m_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        // The buffer contents were lost, so just drop this frame
+        EGL_LOG(Warn, "glUnmapBuffer() failed");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    // With a pixel unpack buffer bound, these are queued like draws
+    // and the data pointer is an offset into the buffer
+    for (int i = 0; i < layout.planeCount; i++) {
+        UPLOAD_PLANE* plane = &layout.planes[i];
+
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, slot->textures[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, plane->pitch / plane->bytesPerTexel);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane->width, plane->height,
+                        plane->format, GL_UNSIGNED_BYTE, (const void*)(uintptr_t)plane->offset);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return true;
+}
+
 void EGLRenderer::renderFrame(AVFrame* frame)
 {
     EGLImage imgs[EGL_MAX_PLANES];
 
+    m_LastSwapStartTimeUs = m_LastPresentTimeUs = 0;
+
     if (frame == nullptr) {
         // End of stream - unbind the GL context
         SDL_GL_MakeCurrent(m_Window, nullptr);
@@ -607,8 +1025,24 @@ void EGLRenderer::renderFrame(AVFrame* frame)
             glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
             m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
         }
+    } else if (m_Backend == nullptr) {
+        if (m_SwPixelFormat == AV_PIX_FMT_NONE) {
+            m_SwPixelFormat = frame->format;
+            m_ColorSpace = frame->colorspace;
+            m_ColorFull = frame->color_range == AVCOL_RANGE_JPEG;
+
+            EGL_LOG(Info, "Uploading software frames of format: %d", m_SwPixelFormat);
+
+            if (!specialize()) {
+                m_SwPixelFormat = AV_PIX_FMT_NONE;
+                return;
+            }
+        }
+
+        if (!uploadSoftwareFrame(frame)) {
+            return;
+        }
     } else {
-        // TODO: load texture for SW decoding ?
         EGL_LOG(Error, "EGL rendering only supports hw frames");
         return;
     }
@@ -618,6 +1052,10 @@ void EGLRenderer::renderFrame(AVFrame* frame)
     m_glBindVertexArrayOES(m_VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+    FrameTrace::Span swapSpan("Swap");
+
+    m_LastSwapStartTimeUs = StreamUtils::getMicroseconds();
+
     SDL_GL_SwapWindow(m_Window);
 
     if (m_BlockingSwapBuffers) {
@@ -629,9 +1067,25 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         // wait here instead allows more time for a newer frame to arrive
         // for next renderFrame() call.
         glClear(GL_COLOR_BUFFER_BIT);
-        glFinish();
+
+        if (m_FenceDepth >= 0) {
+            // Only wait for an older frame's swap, so we don't stall on
+            // the whole GPU pipeline unless the depth is zero
+            waitForSwapFence();
+        }
+        else {
+            glFinish();
+
+            m_LastPresentTimeUs = StreamUtils::getMicroseconds();
+        }
     }
 
     if (frame->hw_frames_ctx != nullptr)
         m_Backend->freeEGLImages(m_EGLDisplay, imgs);
 }
+
+void EGLRenderer::getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs)
+{
+    *swapStartTimeUs = m_LastSwapStartTimeUs;
+    *presentTimeUs = m_LastPresentTimeUs;
+}
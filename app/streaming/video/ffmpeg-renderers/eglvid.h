@@ -1,12 +1,22 @@
 #pragma once
 
 #include "renderer.h"
+#include "streaming/video/latencyhistogram.h"
 
 #include <SDL_opengles2.h>
 #include <SDL_opengles2_gl2ext.h>
 
+// Software frames cycle through this many upload buffers and textures
+#define EGL_UPLOAD_RING_SIZE 3
+
+// How many frames can be in flight on the GPU after a buffer swap
+// before we wait for them. EGL_FENCE_DEPTH overrides the default.
+#define EGL_DEFAULT_FENCE_DEPTH 1
+#define EGL_MAX_FENCE_DEPTH 3
+
 class EGLRenderer : public IFFmpegRenderer {
 public:
+    // The backend renderer is null when we upload software frames ourselves
     EGLRenderer(IFFmpegRenderer *backendRenderer);
     virtual ~EGLRenderer() override;
     virtual bool initialize(PDECODER_PARAMETERS params) override;
@@ -14,6 +24,10 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+    virtual void getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs) override;
+
+    // Returns whether EGL_SOFTWARE_UPLOAD is set
+    static bool isSoftwareUploadEnabled();
 
 private:
 
@@ -22,6 +36,11 @@ private:
     const float *getColorMatrix();
     static int loadAndBuildShader(int shaderType, const char *filename);
     bool openDisplay(unsigned int platform, void* nativeDisplay);
+    bool allocateUploadSlots(AVFrame* frame);
+    void freeUploadSlots();
+    bool uploadSoftwareFrame(AVFrame* frame);
+    void initializeSwapFences();
+    void waitForSwapFence();
 
     int m_SwPixelFormat;
     void *m_EGLDisplay;
@@ -34,11 +53,43 @@ private:
     int m_ColorSpace;
     bool m_ColorFull;
     bool m_BlockingSwapBuffers;
+    Uint64 m_LastSwapStartTimeUs;
+    Uint64 m_LastPresentTimeUs;
     PFNGLEGLIMAGETARGETTEXTURE2DOESPROC m_glEGLImageTargetTexture2DOES;
     PFNGLGENVERTEXARRAYSOESPROC m_glGenVertexArraysOES;
     PFNGLBINDVERTEXARRAYOESPROC m_glBindVertexArrayOES;
     PFNGLDELETEVERTEXARRAYSOESPROC m_glDeleteVertexArraysOES;
 
+    // Software frames are copied into a pixel unpack buffer and from there
+    // into textures of the same slot. Since consecutive frames never share
+    // a buffer or texture, uploading one frame doesn't have to wait for the
+    // GPU to finish drawing the previous one.
+    typedef struct _UPLOAD_SLOT {
+        unsigned buffer;
+        unsigned textures[EGL_MAX_PLANES];
+    } UPLOAD_SLOT;
+    UPLOAD_SLOT m_UploadSlots[EGL_UPLOAD_RING_SIZE];
+    int m_NextUploadSlot;
+    int m_UploadFormat;
+    int m_UploadWidth;
+    int m_UploadHeight;
+    PFNGLMAPBUFFERRANGEEXTPROC m_glMapBufferRange;
+    PFNGLUNMAPBUFFEROESPROC m_glUnmapBuffer;
+
+    // EGL_KHR_fence_sync fences inserted after each buffer swap. We wait on
+    // the one from m_FenceDepth frames ago rather than draining the whole
+    // pipeline with glFinish(). The depth is -1 if we can't use fences.
+    // SDL_egl.h isn't included here, so these use the plain EGL types.
+    int m_FenceDepth;
+    void* m_FenceDisplay;
+    void* m_Fences[EGL_MAX_FENCE_DEPTH + 1];
+    int m_NextFence;
+    void* (*m_eglCreateSyncKHR)(void*, unsigned int, const int*);
+    int (*m_eglClientWaitSyncKHR)(void*, void*, int, Uint64);
+    unsigned int (*m_eglDestroySyncKHR)(void*, void*);
+    LatencyHistogram m_FenceWaitTimes;
+    Uint32 m_BlockedFenceWaits;
+
     int m_OldContextProfileMask;
     int m_OldContextMajorVersion;
     int m_OldContextMinorVersion;
@@ -0,0 +1,142 @@
+#include "null.h"
+
+extern "C" {
+#include <libavutil/adler32.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+NullRenderer::NullRenderer(IFFmpegRenderer* backendRenderer)
+    : m_BackendRenderer(backendRenderer),
+      m_ReadBack(false),
+      m_Checksum(false),
+      m_StreamChecksum(1),
+      m_Frames(0)
+{
+
+}
+
+NullRenderer::~NullRenderer()
+{
+    if (m_Checksum) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Checksum of %d discarded frames: %08x",
+                    m_Frames,
+                    m_StreamChecksum);
+    }
+}
+
+bool NullRenderer::isEnabled()
+{
+    return qEnvironmentVariableIntValue("NULL_RENDERER") != 0;
+}
+
+bool NullRenderer::initialize(PDECODER_PARAMETERS)
+{
+    m_ReadBack = m_BackendRenderer != nullptr && !m_BackendRenderer->isDirectRenderingSupported();
+    m_Checksum = qEnvironmentVariableIntValue("NULL_RENDERER_CHECKSUM") != 0;
+
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                "Discarding decoded frames instead of rendering them (NULL_RENDERER)%s",
+                m_Checksum ? " after checksumming them" : "");
+
+    return true;
+}
+
+bool NullRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
+{
+    /* Nothing to do */
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using null renderer");
+
+    return true;
+}
+
+bool NullRenderer::isPixelFormatSupported(int, AVPixelFormat pixelFormat)
+{
+    // We can discard (or checksum) any software format
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pixelFormat);
+    return desc != nullptr && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL);
+}
+
+bool NullRenderer::checksumFrame(AVFrame* frame, Uint32* checksum)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return false;
+    }
+
+    *checksum = 1;
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; plane++) {
+        // Only the visible part of each line, since the padding up to
+        // the pitch can hold anything
+        int lineSize = av_image_get_linesize((AVPixelFormat)frame->format, frame->width, plane);
+        if (lineSize <= 0) {
+            break;
+        }
+
+        int height = frame->height;
+        if (plane == 1 || plane == 2) {
+            height = AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+        }
+
+        for (int y = 0; y < height; y++) {
+            *checksum = av_adler32_update(*checksum,
+                                          frame->data[plane] + y * frame->linesize[plane],
+                                          lineSize);
+        }
+    }
+
+    return true;
+}
+
+void NullRenderer::renderFrame(AVFrame* frame)
+{
+    AVFrame* swFrame = nullptr;
+
+    if (frame == nullptr) {
+        // End of stream - nothing to do for us
+        return;
+    }
+
+    if (frame->hw_frames_ctx != nullptr && (m_ReadBack || m_Checksum)) {
+        swFrame = av_frame_alloc();
+        if (swFrame == nullptr) {
+            return;
+        }
+
+        // Leaving the format unset reads back in the native format
+        int err = av_hwframe_transfer_data(swFrame, frame, 0);
+        if (err != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwframe_transfer_data() failed: %d",
+                         err);
+            av_frame_free(&swFrame);
+            return;
+        }
+
+        frame = swFrame;
+    }
+
+    if (m_Checksum) {
+        Uint32 checksum;
+        if (checksumFrame(frame, &checksum)) {
+            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
+                         "Frame %d checksum: %08x",
+                         m_Frames,
+                         checksum);
+
+            // Fold it into the stream checksum the same way on any CPU
+            const uint8_t checksumBytes[] = {
+                (uint8_t)(checksum >> 24), (uint8_t)(checksum >> 16),
+                (uint8_t)(checksum >> 8), (uint8_t)checksum
+            };
+            m_StreamChecksum = av_adler32_update(m_StreamChecksum, checksumBytes, sizeof(checksumBytes));
+        }
+    }
+
+    m_Frames++;
+
+    av_frame_free(&swFrame);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "renderer.h"
+
+// Discards frames instead of presenting them, so decode throughput can be
+// measured without the display (or a GPU) in the way. Frames still go
+// through Pacer like any other renderer's.
+class NullRenderer : public IFFmpegRenderer {
+public:
+    // The backend renderer is null when we're the only renderer
+    NullRenderer(IFFmpegRenderer* backendRenderer);
+    virtual ~NullRenderer() override;
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+
+    // Returns whether NULL_RENDERER is set
+    static bool isEnabled();
+
+private:
+    bool checksumFrame(AVFrame* frame, Uint32* checksum);
+
+    IFFmpegRenderer* m_BackendRenderer;
+
+    // Read back hardware frames if the backend can't
+    // render them directly, like SdlRenderer would
+    bool m_ReadBack;
+
+    bool m_Checksum;
+    Uint32 m_StreamChecksum;
+    int m_Frames;
+};
@@ -0,0 +1,88 @@
+#include "cadencescheduler.h"
+
+CadenceScheduler::CadenceScheduler() :
+    m_StreamFps(0),
+    m_DisplayFps(0),
+    m_StreamRate(1),
+    m_DisplayRate(1),
+    m_Accumulator(0),
+    m_PhasePtsMs(-1)
+{
+
+}
+
+void CadenceScheduler::initialize(int streamFps, int displayFps)
+{
+    if (streamFps <= 0 || displayFps <= 0) {
+        return;
+    }
+
+    int a = streamFps, b = displayFps;
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    m_StreamFps = streamFps;
+    m_DisplayFps = displayFps;
+    m_StreamRate = streamFps / a;
+    m_DisplayRate = displayFps / a;
+    m_Accumulator = 0;
+    m_PhasePtsMs = -1;
+
+    if (m_StreamRate > m_DisplayRate) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame cadence: showing %d of every %d frames",
+                    m_DisplayRate, m_StreamRate);
+    }
+    else if (m_StreamRate < m_DisplayRate) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame cadence: showing %d frames over every %d V-syncs",
+                    m_StreamRate, m_DisplayRate);
+    }
+}
+
+Sint64 CadenceScheduler::getDisplaySlot(Sint64 ptsMs)
+{
+    // Put the V-sync boundaries halfway between stream frames, so the
+    // millisecond rounding of the PTS can't move a frame across one
+    double offsetMs = (ptsMs - m_PhasePtsMs) + 500.0 / m_StreamFps;
+    return (Sint64)SDL_floor(offsetMs * m_DisplayFps / 1000.0);
+}
+
+bool CadenceScheduler::isFrameSuperseded(Sint64 ptsMs, Sint64 nextPtsMs)
+{
+    if (m_StreamRate <= m_DisplayRate) {
+        return false;
+    }
+
+    // Start over if the host's timestamps were reset
+    if (m_PhasePtsMs < 0 || ptsMs < m_PhasePtsMs) {
+        m_PhasePtsMs = ptsMs;
+    }
+
+    return nextPtsMs >= ptsMs && getDisplaySlot(ptsMs) == getDisplaySlot(nextPtsMs);
+}
+
+bool CadenceScheduler::isNewFrameDue()
+{
+    if (m_StreamRate >= m_DisplayRate) {
+        return true;
+    }
+
+    m_Accumulator += m_StreamRate;
+    if (m_Accumulator >= m_DisplayRate) {
+        m_Accumulator -= m_DisplayRate;
+        return true;
+    }
+
+    return false;
+}
+
+void CadenceScheduler::missedFrame()
+{
+    // Make the next V-sync due, without building up a backlog
+    // of due V-syncs if the stream stalls for a while
+    m_Accumulator = m_DisplayRate - m_StreamRate;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <SDL.h>
+
+// Works out a fixed pattern for showing a stream on a display with a
+// different refresh rate, so frames are dropped or repeated evenly instead
+// of whenever a queue happens to back up. For example, 60 FPS on a 50 Hz
+// display shows 5 of every 6 frames and 30 FPS on a 60 Hz display shows
+// each frame for 2 V-syncs.
+class CadenceScheduler
+{
+public:
+    CadenceScheduler();
+
+    void initialize(int streamFps, int displayFps);
+
+    // Returns whether a frame is replaced by the next one before the display
+    // gets to show it, because both fall within the same V-sync. Only skips
+    // frames when the stream is faster than the display.
+    bool isFrameSuperseded(Sint64 ptsMs, Sint64 nextPtsMs);
+
+    // Called once per V-sync. Returns whether this V-sync should show a
+    // new frame. Only repeats frames when the stream is slower than the display.
+    bool isNewFrameDue();
+
+    // No frame arrived for the V-sync that was due for one, so shift
+    // the pattern to show the next frame as soon as it arrives.
+    void missedFrame();
+
+private:
+    Sint64 getDisplaySlot(Sint64 ptsMs);
+
+    int m_StreamFps;
+    int m_DisplayFps;
+
+    // Stream and display rates divided by their greatest common divisor
+    int m_StreamRate;
+    int m_DisplayRate;
+    int m_Accumulator;
+
+    // PTS that the display's V-sync slots are measured from
+    Sint64 m_PhasePtsMs;
+};
@@ -1,7 +1,9 @@
 #include "pacer.h"
 #include "streaming/streamutils.h"
+#include "streaming/video/frametrace.h"
 
 #include "nullthreadedvsyncsource.h"
+#include "softwarevsyncsource.h"
 
 #ifdef Q_OS_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -10,27 +12,79 @@
 #include "dxvsyncsource.h"
 #endif
 
-// Limit the number of queued frames to prevent excessive memory consumption
-// if the V-Sync source or renderer is blocked for a while.
-#define MAX_QUEUED_FRAMES 8
+// How strongly each frame's arrival corrects our mapping from host
+// presentation time to our clock. Network jitter is large compared
+// to clock drift, so the rate adapts much more slowly than the phase.
+#define CLOCK_PHASE_GAIN 0.02
+#define CLOCK_RATE_GAIN 0.0005
+
+// Anything beyond this is a glitch in the stream rather than drift
+#define MAX_CLOCK_DRIFT_PPM 5000
+#define MAX_CLOCK_PHASE_ERROR_US 100000
+
+// A PTS this far past the last one means the host restarted its clock
+#define MAX_CLOCK_PTS_JUMP_MS 1000
 
 // We may be woken up slightly late so don't go all the way
 // up to the next V-sync since we may accidentally step into
 // the next V-sync period. It also takes some amount of time
 // to do the render itself, so we can't render right before
-// V-sync happens.
+// V-sync happens. If the renderer tells us how long it takes
+// to get to the buffer swap, we adapt the slack to that.
 #define TIMER_SLACK_MS 3
+#define MIN_TIMER_SLACK_MS 1
+
+QueueLengthHistory::QueueLengthHistory()
+    : m_WindowSize(0),
+      m_TotalSamples(0)
+{
+    SDL_zero(m_LastSeen);
+}
+
+void QueueLengthHistory::setWindowSize(int samples)
+{
+    m_WindowSize = samples;
+}
+
+int QueueLengthHistory::getMinimum()
+{
+    for (int i = 0; i <= MAX_QUEUED_FRAMES; i++) {
+        if (m_LastSeen[i] != 0 && m_TotalSamples - m_LastSeen[i] < (Uint32)m_WindowSize) {
+            return i;
+        }
+    }
+
+    return MAX_QUEUED_FRAMES;
+}
 
-Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
+void QueueLengthHistory::add(int queueLength)
+{
+    m_LastSeen[SDL_min(queueLength, MAX_QUEUED_FRAMES)] = ++m_TotalSamples;
+}
+
+Pacer::Pacer(IFFmpegRenderer* renderer, VideoStatsShard* renderStats, VideoStatsShard* vsyncStats) :
+    m_RenderQueueSemaphore(nullptr),
+    m_PacingQueueSemaphore(nullptr),
     m_RenderThread(nullptr),
-    m_Stopping(false),
     m_VsyncSource(nullptr),
     m_VsyncRenderer(renderer),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
-    m_VideoStats(videoStats)
+    m_AverageRenderTimeUs((TIMER_SLACK_MS - 1) * 1000),
+    m_PtsPacing(false),
+    m_ClockModelValid(false),
+    m_ClockRatio(1.0),
+    m_ModelHostTimeUs(0),
+    m_ModelLocalTimeUs(0),
+    m_LastModeledPts(-1),
+    m_TargetLatencyUs(0),
+    m_LastRenderTimeUs(0),
+    m_RenderStats(renderStats),
+    m_VsyncStats(vsyncStats)
 {
-
+    SDL_AtomicSet(&m_Stopping, 0);
+    SDL_AtomicSet(&m_TimerSlackMs, TIMER_SLACK_MS);
+    SDL_AtomicSet(&m_ClockDriftPpm, 0);
 }
 
 Pacer::~Pacer()
@@ -40,9 +94,9 @@ Pacer::~Pacer()
     m_VsyncSource = nullptr;
 
     // Stop the render thread
-    m_Stopping = true;
+    SDL_AtomicSet(&m_Stopping, 1);
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeAll();
+        SDL_SemPost(m_RenderQueueSemaphore);
         SDL_WaitThread(m_RenderThread, nullptr);
     }
     else {
@@ -51,14 +105,20 @@ Pacer::~Pacer()
     }
 
     // Delete any remaining unconsumed frames
-    while (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
+    AVFrame* frame;
+    while (m_RenderQueue.pop(frame)) {
         av_frame_free(&frame);
     }
-    while (!m_PacingQueue.isEmpty()) {
-        AVFrame* frame = m_PacingQueue.dequeue();
+    while (m_PacingQueue.pop(frame)) {
         av_frame_free(&frame);
     }
+
+    if (m_RenderQueueSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_RenderQueueSemaphore);
+    }
+    if (m_PacingQueueSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_PacingQueueSemaphore);
+    }
 }
 
 void Pacer::renderOnMainThread()
@@ -68,14 +128,11 @@ void Pacer::renderOnMainThread()
         return;
     }
 
-    m_FrameQueueLock.lock();
-
-    if (!m_RenderQueue.isEmpty()) {
-        // Releases m_FrameQueueLock
-        renderLastFrameAndUnlock();
+    if (m_RenderQueue.size() != 0) {
+        renderLastFrame();
     }
     else {
-        m_FrameQueueLock.unlock();
+        m_VsyncRenderer->flushPendingFrame();
     }
 }
 
@@ -83,31 +140,36 @@ int Pacer::renderThread(void* context)
 {
     Pacer* me = reinterpret_cast<Pacer*>(context);
 
+    FrameTrace::setThreadName("PacerRender");
+
     if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "Unable to set render thread to high priority: %s",
                     SDL_GetError());
     }
 
-    while (!me->m_Stopping) {
-        // Acquire the frame queue lock to protect the queue and
-        // the not empty condition
-        me->m_FrameQueueLock.lock();
-
+    for (;;) {
         // Wait for a frame to be ready to render
-        while (!me->m_Stopping && me->m_RenderQueue.isEmpty()) {
-            me->m_RenderQueueNotEmpty.wait(&me->m_FrameQueueLock);
-        }
+        bool timedOut = SDL_SemWaitTimeout(me->m_RenderQueueSemaphore, 1000 / me->m_MaxVideoFps) != 0;
 
-        if (me->m_Stopping) {
+        if (SDL_AtomicGet(&me->m_Stopping) != 0) {
             // Exit this thread
-            me->m_FrameQueueLock.unlock();
             break;
         }
 
-        // Render the latest frame and discard the others
-        // NB: m_FrameQueueLock still held here!
-        me->renderLastFrameAndUnlock();
+        if (timedOut) {
+            // No new frame for a frame interval, so make sure the
+            // renderer isn't sitting on the last one
+            me->m_VsyncRenderer->flushPendingFrame();
+            continue;
+        }
+
+        // We get a wakeup per frame but render all queued frames at once,
+        // so we may find the queue already empty here.
+        if (me->m_RenderQueue.size() != 0) {
+            // Render the latest frame and discard the others
+            me->renderLastFrame();
+        }
     }
 
     // Send a null AVFrame to indicate end of stream on the render thread
@@ -116,15 +178,18 @@ int Pacer::renderThread(void* context)
     return 0;
 }
 
-void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
+// Called on the render queue producer thread
+void Pacer::enqueueFrameForRendering(AVFrame *frame)
 {
-    dropFrameForEnqueue(m_RenderQueue);
-    m_RenderQueue.enqueue(frame);
-
-    m_FrameQueueLock.unlock();
+    // Only the consumer can drop from the head of the queue, so if it's
+    // stalled long enough to fill the queue, this frame is the one we drop.
+    if (!m_RenderQueue.push(frame)) {
+        av_frame_free(&frame);
+        return;
+    }
 
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeOne();
+        SDL_SemPost(m_RenderQueueSemaphore);
     }
     else {
         SDL_Event event;
@@ -136,31 +201,34 @@ void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
     }
 }
 
-// Caller must hold m_FrameQueueLock
-void Pacer::renderLastFrameAndUnlock()
+// Called on the render queue consumer thread
+void Pacer::renderLastFrame()
 {
-    // Dequeue the most recent frame for rendering and free the others.
+    AVFrame* droppedFrames[MAX_QUEUED_FRAMES];
+    int droppedFrameCount = 0;
+
+    // Dequeue the most recent frame for rendering and drop the others.
+    // Only take what's queued now, so we don't chase a running producer.
     AVFrame* lastFrame = nullptr;
-    while (!m_RenderQueue.isEmpty()) {
-        if (lastFrame != nullptr) {
-            // Don't hold the frame queue lock across av_frame_free(),
-            // since it could need to talk to the GPU driver. This is safe
-            // because we're guaranteed that the queue will not shrink during
-            // this time (and so dequeue() below will always get something).
-            m_FrameQueueLock.unlock();
-            av_frame_free(&lastFrame);
-            m_VideoStats->pacerDroppedFrames++;
-            m_FrameQueueLock.lock();
+    for (int i = m_RenderQueue.size(); i > 0; i--) {
+        AVFrame* frame;
+        if (!m_RenderQueue.pop(frame)) {
+            break;
         }
 
-        lastFrame = m_RenderQueue.dequeue();
+        if (lastFrame != nullptr) {
+            droppedFrames[droppedFrameCount++] = lastFrame;
+        }
+        lastFrame = frame;
     }
 
-    // Release the frame queue lock before rendering
-    m_FrameQueueLock.unlock();
+    // Render and free the most current frame
+    if (lastFrame != nullptr) {
+        renderFrame(lastFrame);
+    }
 
-    // Render and free the mot current frame
-    renderFrame(lastFrame);
+    // Now that the frame is on screen, we can afford to free the others
+    releaseDroppedFrames(droppedFrames, droppedFrameCount, m_RenderStats);
 }
 
 // Called in an arbitrary thread by the IVsyncSource on V-sync
@@ -170,9 +238,12 @@ void Pacer::vsyncCallback(int timeUntilNextVsyncMillis)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    SDL_assert(timeUntilNextVsyncMillis >= TIMER_SLACK_MS);
+    FrameTrace::Span span("V-sync");
 
-    m_FrameQueueLock.lock();
+    if (m_PtsPacing) {
+        presentFrameByPts(timeUntilNextVsyncMillis);
+        return;
+    }
 
     // If the queue length history entries are large, be strict
     // about dropping excess frames.
@@ -182,67 +253,130 @@ void Pacer::vsyncCallback(int timeUntilNextVsyncMillis)
     // frame history to drop frames only if consistently above the
     // one queued frame mark.
     if (m_MaxVideoFps >= m_DisplayFps) {
-        for (int queueHistoryEntry : m_PacingQueueHistory) {
-            if (queueHistoryEntry <= 1) {
-                // Be lenient as long as the queue length
-                // resolves before the end of frame history
-                frameDropTarget = 3;
-                break;
-            }
+        if (m_PacingQueueHistory.getMinimum() <= 1) {
+            // Be lenient as long as the queue length
+            // resolves before the end of frame history
+            frameDropTarget = 3;
         }
 
-        // Keep a rolling 500 ms window of pacing queue history
-        if (m_PacingQueueHistory.count() == m_DisplayFps / 2) {
-            m_PacingQueueHistory.dequeue();
-        }
+        m_PacingQueueHistory.add(m_PacingQueue.size());
+    }
 
-        m_PacingQueueHistory.enqueue(m_PacingQueue.count());
+    // Catch up if we're several frames ahead. The dropped frames are
+    // freed after this V-sync's frame has been handed off for rendering.
+    AVFrame* droppedFrames[MAX_QUEUED_FRAMES];
+    int droppedFrameCount = 0;
+    while (m_PacingQueue.size() > frameDropTarget && droppedFrameCount < MAX_QUEUED_FRAMES) {
+        m_PacingQueue.pop(droppedFrames[droppedFrameCount++]);
     }
 
-    // Catch up if we're several frames ahead
-    while (m_PacingQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_PacingQueue.dequeue();
+    if (!m_Cadence.isNewFrameDue()) {
+        // Keep the current frame on screen for this V-sync
+        releaseDroppedFrames(droppedFrames, droppedFrameCount, m_VsyncStats);
+        return;
+    }
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
+    // Wait for a frame to arrive or our V-sync timeout to expire. We get a
+    // wakeup per frame, so some may be left over for frames we already took.
+    Uint32 deadline = SDL_GetTicks() + timeUntilNextVsyncMillis - SDL_AtomicGet(&m_TimerSlackMs);
+    AVFrame* frame = nullptr;
+    while (!m_PacingQueue.pop(frame)) {
+        Uint32 now = SDL_GetTicks();
+        if (SDL_TICKS_PASSED(now, deadline) ||
+                SDL_SemWaitTimeout(m_PacingQueueSemaphore, deadline - now) != 0) {
+            // Wait timed out
+            frame = nullptr;
+            break;
+        }
+    }
+
+    // Skip frames that share a V-sync with a later one, but only once the
+    // later frame has arrived, so we never hold back the newest frame
+    int cadenceSkippedFrames = 0;
+    AVFrame* nextFrame;
+    while (frame != nullptr && m_PacingQueue.peek(nextFrame) &&
+           m_Cadence.isFrameSuperseded(frame->pts, nextFrame->pts)) {
+        m_PacingQueue.pop(nextFrame);
         av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+        frame = nextFrame;
+        cadenceSkippedFrames++;
     }
 
-    if (m_PacingQueue.isEmpty()) {
-        // Wait for a frame to arrive or our V-sync timeout to expire
-        if (!m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, timeUntilNextVsyncMillis - TIMER_SLACK_MS)) {
-            // Wait timed out - unlock and bail
-            m_FrameQueueLock.unlock();
-            return;
-        }
+    if (cadenceSkippedFrames != 0) {
+        m_VsyncStats->beginUpdate();
+        m_VsyncStats->add(VSC_CADENCE_SKIPPED_FRAMES, cadenceSkippedFrames);
+        m_VsyncStats->endUpdate();
     }
 
     // Place the first frame on the render queue
-    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+    if (frame != nullptr) {
+        enqueueFrameForRendering(frame);
+    }
+    else {
+        m_Cadence.missedFrame();
+    }
+
+    releaseDroppedFrames(droppedFrames, droppedFrameCount, m_VsyncStats);
 }
 
 bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
 {
     m_MaxVideoFps = maxVideoFps;
-    m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+    if (m_DisplayFps == 0) {
+        m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+    }
+
+    // The V-sync source can call us as soon as it starts,
+    // so everything it uses must be ready before then.
+    m_PacingQueueHistory.setWindowSize(m_DisplayFps / 2);
+    m_RenderQueueHistory.setWindowSize(m_MaxVideoFps / 2);
+
+    m_RenderQueueSemaphore = SDL_CreateSemaphore(0);
+    m_PacingQueueSemaphore = SDL_CreateSemaphore(0);
+    if (m_RenderQueueSemaphore == nullptr || m_PacingQueueSemaphore == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create frame queue semaphores: %s",
+                     SDL_GetError());
+        return false;
+    }
 
     if (enablePacing) {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing active: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
 
+        // Unless we've been given a simulated display
+        if (m_VsyncSource == nullptr) {
     #if defined(Q_OS_WIN32)
-        // Don't use D3DKMTWaitForVerticalBlankEvent() on Windows 7, because
-        // it blocks during other concurrent DX operations (like actually rendering).
-        if (IsWindows8OrGreater()) {
-            m_VsyncSource = new DxVsyncSource(this);
-        }
+            // Don't use D3DKMTWaitForVerticalBlankEvent() on Windows 7, because
+            // it blocks during other concurrent DX operations (like actually rendering).
+            // Without a VsyncSource, we'll just render frames immediately
+            // like we used to.
+            if (IsWindows8OrGreater()) {
+                m_VsyncSource = new DxVsyncSource(this);
+            }
+    #elif defined(Q_OS_LINUX)
+            // Linux (including webOS) doesn't tell us when V-sync happens, so we predict it
+            m_VsyncSource = new SoftwareVsyncSource(this);
     #else
-        // Platforms without a VsyncSource will just render frames
-        // immediately like they used to.
+            // Platforms without a VsyncSource will just render frames
+            // immediately like they used to.
     #endif
+        }
+
+        if (m_VsyncSource != nullptr && qEnvironmentVariableIntValue("PTS_PACING") != 0) {
+            // Aim to show each frame about one V-sync period after it would
+            // have been ready on average. Jitter inside that is absorbed.
+            m_PtsPacing = true;
+            m_TargetLatencyUs = 1000000 / m_DisplayFps;
+
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Pacing frames by host presentation time");
+        }
+        else if (m_VsyncSource != nullptr) {
+            // PTS pacing finds its own cadence, so this is only for the queue-based pacing
+            m_Cadence.initialize(m_MaxVideoFps, m_DisplayFps);
+        }
 
         if (m_VsyncSource != nullptr && !m_VsyncSource->initialize(window, m_DisplayFps)) {
             return false;
@@ -252,6 +386,10 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing disabled: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
+
+        // Frames go straight to the render queue without a V-sync source
+        delete m_VsyncSource;
+        m_VsyncSource = nullptr;
     }
 
     if (m_VsyncRenderer->isRenderThreadSupported()) {
@@ -264,58 +402,239 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
 void Pacer::renderFrame(AVFrame* frame)
 {
     // Count time spent in Pacer's queues
-    Uint32 beforeRender = SDL_GetTicks();
-    m_VideoStats->totalPacerTime += beforeRender - frame->pkt_dts;
+    Uint64 beforeRender = StreamUtils::getMicroseconds();
+    PFRAME_TIMESTAMPS timestamps = frame->opaque_ref != nullptr ?
+                (PFRAME_TIMESTAMPS)frame->opaque_ref->data : nullptr;
+    Uint64 decodeEndTimeUs = timestamps != nullptr ? timestamps->decodeEndTimeUs : 0;
 
     // Render it
-    m_VsyncRenderer->renderFrame(frame);
-    Uint32 afterRender = SDL_GetTicks();
+    {
+        FrameTrace::Span span("renderFrame", getFrameNumber(frame));
+        m_VsyncRenderer->renderFrame(frame);
+    }
+    Uint64 afterRender = StreamUtils::getMicroseconds();
+
+    Uint64 swapStartTimeUs, presentTimeUs;
+    m_VsyncRenderer->getLastSwapTimes(&swapStartTimeUs, &presentTimeUs);
+    if (swapStartTimeUs != 0) {
+        updateTimerSlack(swapStartTimeUs - beforeRender);
+    }
+    if (presentTimeUs != 0 && m_VsyncSource != nullptr) {
+        m_VsyncSource->notifyFramePresented(presentTimeUs);
+    }
 
-    m_VideoStats->totalRenderTime += afterRender - beforeRender;
-    m_VideoStats->renderedFrames++;
+    m_RenderStats->beginUpdate();
+    if (timestamps != nullptr) {
+        m_RenderStats->record(VSS_PACER, beforeRender - decodeEndTimeUs);
+    }
+    m_RenderStats->record(VSS_RENDER, afterRender - beforeRender);
+    m_RenderStats->add(VSC_RENDERED_FRAMES, 1);
+    if (m_LastRenderTimeUs != 0) {
+        m_RenderStats->record(VSS_RENDERED_FRAME_INTERVAL, afterRender - m_LastRenderTimeUs);
+    }
+    m_RenderStats->endUpdate();
+    m_LastRenderTimeUs = afterRender;
     av_frame_free(&frame);
 
     // Drop frames if we have too many queued up for a while
-    m_FrameQueueLock.lock();
-
     int frameDropTarget = 0;
-    for (int queueHistoryEntry : m_RenderQueueHistory) {
-        if (queueHistoryEntry == 0) {
-            // Be lenient as long as the queue length
-            // resolves before the end of frame history
-            frameDropTarget = 2;
+    if (m_RenderQueueHistory.getMinimum() == 0) {
+        // Be lenient as long as the queue length
+        // resolves before the end of frame history
+        frameDropTarget = 2;
+    }
+
+    m_RenderQueueHistory.add(m_RenderQueue.size());
+
+    // Catch up if we're several frames ahead
+    AVFrame* droppedFrames[MAX_QUEUED_FRAMES];
+    int droppedFrameCount = 0;
+    while (m_RenderQueue.size() > frameDropTarget && droppedFrameCount < MAX_QUEUED_FRAMES) {
+        m_RenderQueue.pop(droppedFrames[droppedFrameCount++]);
+    }
+
+    releaseDroppedFrames(droppedFrames, droppedFrameCount, m_RenderStats);
+}
+
+void Pacer::setSimulatedDisplay(IVsyncSource* vsyncSource, int displayFps)
+{
+    SDL_assert(m_MaxVideoFps == 0);
+
+    delete m_VsyncSource;
+    m_VsyncSource = vsyncSource;
+    m_DisplayFps = displayFps;
+}
+
+bool Pacer::getClockDriftPpm(int* driftPpm)
+{
+    *driftPpm = SDL_AtomicGet(&m_ClockDriftPpm);
+    return m_PtsPacing;
+}
+
+// Called on the V-sync thread for each frame before it leaves the pacing queue
+void Pacer::updateClockModel(AVFrame* frame)
+{
+    if (frame->opaque_ref == nullptr || frame->pts == m_LastModeledPts) {
+        // No timestamps or we've already seen this frame
+        return;
+    }
+
+    if (m_LastModeledPts >= 0 &&
+            (frame->pts < m_LastModeledPts || frame->pts - m_LastModeledPts > MAX_CLOCK_PTS_JUMP_MS)) {
+        // Frames leave the decoder in order, so the host's timestamps were
+        // reset or wrapped. The old phase means nothing for these frames.
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame %d PTS jumped from %lld to %lld; resetting clock model",
+                    getFrameNumber(frame),
+                    (long long)m_LastModeledPts,
+                    (long long)frame->pts);
+        m_ClockModelValid = false;
+    }
+
+    m_LastModeledPts = frame->pts;
+
+    // When the frame was ready for us, in our clock
+    double localTimeUs = (double)((PFRAME_TIMESTAMPS)frame->opaque_ref->data)->decodeEndTimeUs;
+    double hostTimeUs = (double)frame->pts * 1000;
+
+    if (m_ClockModelValid) {
+        double hostElapsedUs = hostTimeUs - m_ModelHostTimeUs;
+        double predictedTimeUs = m_ModelLocalTimeUs + hostElapsedUs * m_ClockRatio;
+        double errorUs = localTimeUs - predictedTimeUs;
+
+        if (SDL_fabs(errorUs) < MAX_CLOCK_PHASE_ERROR_US) {
+            // Pull our phase toward this frame and nudge the rate by the error
+            // accumulated over the time since the last frame.
+            m_ModelLocalTimeUs = predictedTimeUs + errorUs * CLOCK_PHASE_GAIN;
+            m_ModelHostTimeUs = hostTimeUs;
+            m_ClockRatio += errorUs * CLOCK_RATE_GAIN / hostElapsedUs;
+            m_ClockRatio = SDL_max(m_ClockRatio, 1 - MAX_CLOCK_DRIFT_PPM / 1000000.0);
+            m_ClockRatio = SDL_min(m_ClockRatio, 1 + MAX_CLOCK_DRIFT_PPM / 1000000.0);
+
+            SDL_AtomicSet(&m_ClockDriftPpm, (int)((m_ClockRatio - 1) * 1000000));
+            return;
+        }
+
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame %d was %.1f ms away from its predicted time; resetting clock model",
+                    getFrameNumber(frame),
+                    errorUs / 1000);
+    }
+
+    // Start over from this frame, keeping our estimate of the rate
+    m_ModelLocalTimeUs = localTimeUs;
+    m_ModelHostTimeUs = hostTimeUs;
+    m_ClockModelValid = true;
+}
+
+Uint64 Pacer::getTargetDisplayTime(AVFrame* frame)
+{
+    if (!m_ClockModelValid || frame->opaque_ref == nullptr) {
+        // Show it as soon as we can
+        return 0;
+    }
+
+    double hostElapsedUs = (double)frame->pts * 1000 - m_ModelHostTimeUs;
+    return (Uint64)SDL_max(m_ModelLocalTimeUs + hostElapsedUs * m_ClockRatio, 0.0) + m_TargetLatencyUs;
+}
+
+// Called on the V-sync thread instead of the queue history logic when pacing
+// by PTS. Drift between the host and display shows up as a frame that isn't
+// due yet (we hold it for the next V-sync) or two frames due for the same
+// V-sync (we skip the older one), rather than a growing or draining queue.
+void Pacer::presentFrameByPts(int timeUntilNextVsyncMillis)
+{
+    Uint64 nowUs = StreamUtils::getMicroseconds();
+    Uint64 displayTimeUs = nowUs + timeUntilNextVsyncMillis * 1000;
+    Uint32 deadline = SDL_GetTicks() + timeUntilNextVsyncMillis - SDL_AtomicGet(&m_TimerSlackMs);
+
+    // Round to the nearest V-sync rather than always showing frames early
+    displayTimeUs += 500000 / m_DisplayFps;
+
+    AVFrame* droppedFrames[MAX_QUEUED_FRAMES];
+    int droppedFrameCount = 0;
+    AVFrame* dueFrame = nullptr;
+    bool holding = false;
+
+    for (;;) {
+        AVFrame* frame;
+
+        // Take every frame that's due by this V-sync and keep the newest
+        for (int i = 0; i < MAX_QUEUED_FRAMES && m_PacingQueue.peek(frame); i++) {
+            updateClockModel(frame);
+            if (getTargetDisplayTime(frame) > displayTimeUs) {
+                holding = true;
+                break;
+            }
+
+            m_PacingQueue.pop(frame);
+            if (dueFrame != nullptr) {
+                droppedFrames[droppedFrameCount++] = dueFrame;
+            }
+            dueFrame = frame;
+        }
+
+        if (dueFrame != nullptr || holding) {
+            break;
+        }
+
+        // The queue is empty, so wait for a frame to arrive or our V-sync timeout
+        // to expire. There may be leftover wakeups for frames we already took.
+        Uint32 now = SDL_GetTicks();
+        if (SDL_TICKS_PASSED(now, deadline) ||
+                SDL_SemWaitTimeout(m_PacingQueueSemaphore, deadline - now) != 0) {
             break;
         }
     }
 
-    // Keep a rolling 500 ms window of render queue history
-    if (m_RenderQueueHistory.count() == m_MaxVideoFps / 2) {
-        m_RenderQueueHistory.dequeue();
+    if (dueFrame != nullptr) {
+        enqueueFrameForRendering(dueFrame);
+    }
+    else if (holding) {
+        m_VsyncStats->beginUpdate();
+        m_VsyncStats->add(VSC_PACER_HELD_FRAMES, 1);
+        m_VsyncStats->endUpdate();
     }
 
-    m_RenderQueueHistory.enqueue(m_RenderQueue.count());
+    releaseDroppedFrames(droppedFrames, droppedFrameCount, m_VsyncStats);
+}
 
-    // Catch up if we're several frames ahead
-    while (m_RenderQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_RenderQueue.dequeue();
+// Called on the render thread
+void Pacer::updateTimerSlack(Uint64 renderTimeUs)
+{
+    // Smooth over roughly the last 16 frames
+    m_AverageRenderTimeUs += ((Sint64)renderTimeUs - m_AverageRenderTimeUs) / 16;
+
+    // Leave time to render up to the swap, plus a millisecond for waking up late.
+    // Don't let a slow renderer eat more than half of each V-sync period though.
+    int timerSlackMs = (int)((m_AverageRenderTimeUs + 999) / 1000) + 1;
+    timerSlackMs = SDL_min(timerSlackMs, 500 / m_DisplayFps);
+    timerSlackMs = SDL_max(timerSlackMs, MIN_TIMER_SLACK_MS);
+    SDL_AtomicSet(&m_TimerSlackMs, timerSlackMs);
+}
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+void Pacer::releaseDroppedFrames(AVFrame** frames, int count, VideoStatsShard* stats)
+{
+    if (count == 0) {
+        return;
     }
 
-    m_FrameQueueLock.unlock();
+    for (int i = 0; i < count; i++) {
+        av_frame_free(&frames[i]);
+    }
+
+    stats->beginUpdate();
+    stats->add(VSC_PACER_DROPPED_FRAMES, count);
+    stats->endUpdate();
 }
 
-void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
+int Pacer::getFrameNumber(AVFrame* frame)
 {
-    SDL_assert(queue.size() <= MAX_QUEUED_FRAMES);
-    if (queue.size() == MAX_QUEUED_FRAMES) {
-        AVFrame* frame = queue.dequeue();
-        av_frame_free(&frame);
+    if (frame->opaque_ref == nullptr) {
+        return -1;
     }
+
+    return ((PFRAME_TIMESTAMPS)frame->opaque_ref->data)->frameNumber;
 }
 
 void Pacer::submitFrame(AVFrame* frame)
@@ -323,15 +642,20 @@ void Pacer::submitFrame(AVFrame* frame)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
+    FrameTrace::Span span("Pacer::submitFrame", getFrameNumber(frame));
+
     // Queue the frame and possibly wake up the render thread
-    m_FrameQueueLock.lock();
     if (m_VsyncSource != nullptr) {
-        dropFrameForEnqueue(m_PacingQueue);
-        m_PacingQueue.enqueue(frame);
-        m_FrameQueueLock.unlock();
-        m_PacingQueueNotEmpty.wakeOne();
+        // The V-sync thread drops from the head of the queue, so if it's
+        // stalled long enough to fill the queue, this frame is the one we drop.
+        if (m_PacingQueue.push(frame)) {
+            SDL_SemPost(m_PacingQueueSemaphore);
+        }
+        else {
+            av_frame_free(&frame);
+        }
     }
     else {
-        enqueueFrameForRenderingAndUnlock(frame);
+        enqueueFrameForRendering(frame);
     }
 }
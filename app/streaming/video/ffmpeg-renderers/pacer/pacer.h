@@ -1,22 +1,59 @@
 #pragma once
 
 #include "../../decoder.h"
+#include "../../spscring.h"
+#include "../../videostatsshard.h"
 #include "../renderer.h"
+#include "cadencescheduler.h"
 
-#include <QQueue>
-#include <QMutex>
-#include <QWaitCondition>
+// Limit the number of queued frames to prevent excessive memory consumption
+// if the V-Sync source or renderer is blocked for a while.
+#define MAX_QUEUED_FRAMES 8
+
+// Timestamps that travel with each decoded frame in AVFrame::opaque_ref
+typedef struct _FRAME_TIMESTAMPS {
+    Uint64 receiveTimeUs;
+    Uint64 decodeStartTimeUs;
+    Uint64 decodeEndTimeUs;
+    int frameNumber;
+} FRAME_TIMESTAMPS, *PFRAME_TIMESTAMPS;
 
 class IVsyncSource {
 public:
     virtual ~IVsyncSource() {}
     virtual bool initialize(SDL_Window* window, int displayFps) = 0;
+
+    // Called after a frame was presented by a renderer that waits for V-sync
+    virtual void notifyFramePresented(Uint64) {}
+};
+
+// Tracks the shortest queue length seen over a rolling window of samples.
+// Queue lengths are bounded, so we just remember when each length was last
+// seen rather than keeping the whole window around.
+class QueueLengthHistory
+{
+public:
+    QueueLengthHistory();
+
+    void setWindowSize(int samples);
+
+    // Returns MAX_QUEUED_FRAMES if there's no history yet
+    int getMinimum();
+
+    void add(int queueLength);
+
+private:
+    int m_WindowSize;
+    Uint32 m_TotalSamples;
+
+    // Sample number (starting at 1) when each queue length was last seen
+    Uint32 m_LastSeen[MAX_QUEUED_FRAMES + 1];
 };
 
 class Pacer
 {
 public:
-    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats);
+    Pacer(IFFmpegRenderer* renderer, VideoStatsShard* renderStats, VideoStatsShard* vsyncStats);
 
     ~Pacer();
 
@@ -24,34 +61,73 @@ public:
 
     bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
 
+    // Stands in a simulated display for the window's, such as for benchmarks.
+    // Must be called before initialize(). We take ownership of the V-sync
+    // source, which is only used if pacing is enabled.
+    void setSimulatedDisplay(IVsyncSource* vsyncSource, int displayFps);
+
     void vsyncCallback(int timeUntilNextVsyncMillis);
 
     void renderOnMainThread();
 
+    // Returns false unless we're pacing by host presentation time
+    bool getClockDriftPpm(int* driftPpm);
+
 private:
     static int renderThread(void* context);
 
-    void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
+    void enqueueFrameForRendering(AVFrame* frame);
 
-    void renderLastFrameAndUnlock();
+    void renderLastFrame();
 
     void renderFrame(AVFrame* frame);
 
-    void dropFrameForEnqueue(QQueue<AVFrame*>& queue);
+    void releaseDroppedFrames(AVFrame** frames, int count, VideoStatsShard* stats);
+
+    void updateTimerSlack(Uint64 renderTimeUs);
+
+    void presentFrameByPts(int timeUntilNextVsyncMillis);
+
+    void updateClockModel(AVFrame* frame);
+
+    Uint64 getTargetDisplayTime(AVFrame* frame);
+
+    static int getFrameNumber(AVFrame* frame);
 
-    QQueue<AVFrame*> m_RenderQueue;
-    QQueue<AVFrame*> m_PacingQueue;
-    QQueue<int> m_PacingQueueHistory;
-    QQueue<int> m_RenderQueueHistory;
-    QMutex m_FrameQueueLock;
-    QWaitCondition m_RenderQueueNotEmpty;
-    QWaitCondition m_PacingQueueNotEmpty;
+    // Each queue has a single producer and consumer thread. The pacing queue
+    // goes from submitFrame() to the V-sync thread. The render queue goes from
+    // the V-sync thread (or submitFrame() without one) to the render thread
+    // (or the main thread).
+    SpscRing<AVFrame*, MAX_QUEUED_FRAMES> m_RenderQueue;
+    SpscRing<AVFrame*, MAX_QUEUED_FRAMES> m_PacingQueue;
+    SDL_sem* m_RenderQueueSemaphore;
+    SDL_sem* m_PacingQueueSemaphore;
+    QueueLengthHistory m_PacingQueueHistory;
+    QueueLengthHistory m_RenderQueueHistory;
     SDL_Thread* m_RenderThread;
-    bool m_Stopping;
+    SDL_atomic_t m_Stopping;
 
     IVsyncSource* m_VsyncSource;
     IFFmpegRenderer* m_VsyncRenderer;
     int m_MaxVideoFps;
     int m_DisplayFps;
-    PVIDEO_STATS m_VideoStats;
+    SDL_atomic_t m_TimerSlackMs;
+    Sint64 m_AverageRenderTimeUs;
+
+    // Maps host presentation timestamps onto our clock when pacing by PTS.
+    // Only used on the V-sync thread, except for the drift estimate.
+    bool m_PtsPacing;
+    bool m_ClockModelValid;
+    double m_ClockRatio;
+    double m_ModelHostTimeUs;
+    double m_ModelLocalTimeUs;
+    Sint64 m_LastModeledPts;
+    Uint64 m_TargetLatencyUs;
+    SDL_atomic_t m_ClockDriftPpm;
+
+    // Only used on the V-sync thread
+    CadenceScheduler m_Cadence;
+    Uint64 m_LastRenderTimeUs;
+    VideoStatsShard* m_RenderStats;
+    VideoStatsShard* m_VsyncStats;
 };
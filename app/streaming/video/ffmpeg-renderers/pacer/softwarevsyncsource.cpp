@@ -0,0 +1,110 @@
+#include "softwarevsyncsource.h"
+#include "streaming/streamutils.h"
+
+// How strongly each observed presentation pulls our phase and refresh
+// period towards the display's. Small values smooth out swap jitter.
+#define PHASE_CORRECTION_GAIN 0.1
+#define PERIOD_CORRECTION_GAIN 0.01
+
+// The display can't be running that far from its reported refresh rate
+#define MAX_PERIOD_DEVIATION 0.02
+
+SoftwareVsyncSource::SoftwareVsyncSource(Pacer* pacer) :
+    m_Pacer(pacer),
+    m_Thread(nullptr),
+    m_ModelLock(0),
+    m_NominalPeriodUs(0),
+    m_PeriodUs(0),
+    m_ReferenceVsyncTimeUs(0)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+SoftwareVsyncSource::~SoftwareVsyncSource()
+{
+    if (m_Thread != nullptr) {
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_WaitThread(m_Thread, nullptr);
+    }
+}
+
+bool SoftwareVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    m_NominalPeriodUs = m_PeriodUs = 1000000.0 / displayFps;
+
+    // We don't know the phase until the first frame is presented
+    m_ReferenceVsyncTimeUs = (double)StreamUtils::getMicroseconds();
+
+    m_Thread = SDL_CreateThread(vsyncThread, "SoftwareVsync", this);
+    if (m_Thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create software V-sync thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+// Called on the render thread
+void SoftwareVsyncSource::notifyFramePresented(Uint64 presentTimeUs)
+{
+    SDL_AtomicLock(&m_ModelLock);
+
+    // Find the predicted V-sync closest to this presentation
+    double elapsedUs = (double)presentTimeUs - m_ReferenceVsyncTimeUs;
+    double periods = SDL_floor(elapsedUs / m_PeriodUs + 0.5);
+    double errorUs = elapsedUs - periods * m_PeriodUs;
+
+    // Move our phase toward what we observed. Moving the reference up to
+    // the latest V-sync also keeps the prediction error from accumulating.
+    m_ReferenceVsyncTimeUs += periods * m_PeriodUs + errorUs * PHASE_CORRECTION_GAIN;
+
+    // A phase error that builds up over several periods means our
+    // refresh period is off (such as 59.94 Hz reported as 60 Hz).
+    if (periods >= 1) {
+        m_PeriodUs += errorUs * PERIOD_CORRECTION_GAIN / periods;
+        m_PeriodUs = SDL_max(m_PeriodUs, m_NominalPeriodUs * (1 - MAX_PERIOD_DEVIATION));
+        m_PeriodUs = SDL_min(m_PeriodUs, m_NominalPeriodUs * (1 + MAX_PERIOD_DEVIATION));
+    }
+
+    SDL_AtomicUnlock(&m_ModelLock);
+}
+
+Uint64 SoftwareVsyncSource::getNextVsyncTime(Uint64 timeUs)
+{
+    SDL_AtomicLock(&m_ModelLock);
+    double referenceTimeUs = m_ReferenceVsyncTimeUs;
+    double periodUs = m_PeriodUs;
+    SDL_AtomicUnlock(&m_ModelLock);
+
+    double periods = SDL_floor(((double)timeUs - referenceTimeUs) / periodUs) + 1;
+    return (Uint64)(referenceTimeUs + periods * periodUs);
+}
+
+int SoftwareVsyncSource::vsyncThread(void* context)
+{
+    SoftwareVsyncSource* me = reinterpret_cast<SoftwareVsyncSource*>(context);
+
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+#endif
+
+    while (SDL_AtomicGet(&me->m_Stopping) == 0) {
+        // Sleep until the next predicted V-sync
+        Uint64 nowUs = StreamUtils::getMicroseconds();
+        Uint64 vsyncTimeUs = me->getNextVsyncTime(nowUs);
+        SDL_Delay((Uint32)((vsyncTimeUs - nowUs) / 1000));
+
+        // We may wake up a bit early or late, so tell Pacer exactly how long
+        // it has until the following V-sync. Skip ahead a millisecond so
+        // rounding can't give us back the V-sync we just slept until.
+        nowUs = StreamUtils::getMicroseconds();
+        Uint64 nextVsyncTimeUs = me->getNextVsyncTime(SDL_max(nowUs, vsyncTimeUs) + 1000);
+        me->m_Pacer->vsyncCallback((int)((nextVsyncTimeUs - nowUs) / 1000));
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pacer.h"
+
+// Predicts V-sync from the display refresh rate for platforms that can't
+// tell us when it happens. The model is phase-locked to the presentation
+// times reported by renderers that wait for V-sync when swapping buffers.
+class SoftwareVsyncSource : public IVsyncSource
+{
+public:
+    SoftwareVsyncSource(Pacer* pacer);
+
+    virtual ~SoftwareVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps);
+
+    virtual void notifyFramePresented(Uint64 presentTimeUs);
+
+private:
+    static int vsyncThread(void* context);
+
+    Uint64 getNextVsyncTime(Uint64 timeUs);
+
+    Pacer* m_Pacer;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+
+    // Shared between the V-sync thread and the render thread
+    SDL_SpinLock m_ModelLock;
+    double m_NominalPeriodUs;
+    double m_PeriodUs;
+    double m_ReferenceVsyncTimeUs;
+};
@@ -35,6 +35,10 @@ public:
     virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) = 0;
     virtual void renderFrame(AVFrame* frame) = 0;
 
+    // Called on the render thread when no new frame has arrived for a while.
+    // Renderers that hold frames back should present the latest one now.
+    virtual void flushPendingFrame() {}
+
     virtual bool needsTestFrame() {
         // No test frame required by default
         return false;
@@ -55,6 +59,15 @@ public:
         return COLORSPACE_REC_601;
     }
 
+    // Times from StreamUtils::getMicroseconds() around the buffer swap in the
+    // last renderFrame() call, or zero if unknown. The present time is only
+    // reported if the swap waited for V-sync, since that tells us when V-sync
+    // actually happened.
+    virtual void getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs) {
+        *swapStartTimeUs = 0;
+        *presentTimeUs = 0;
+    }
+
     virtual bool isRenderThreadSupported() {
         // Render thread is supported by default
         return true;
@@ -2,6 +2,8 @@
 
 #include "streaming/session.h"
 #include "streaming/streamutils.h"
+#include "streaming/video/frametrace.h"
+#include "streaming/video/planecopy.h"
 #include "path.h"
 
 #include <QDir>
@@ -12,44 +14,48 @@ SdlRenderer::SdlRenderer()
     : m_Renderer(nullptr),
       m_Texture(nullptr),
       m_SwPixelFormat(AV_PIX_FMT_NONE),
-      m_FontData(Path::readDataFile("ModeSeven.ttf"))
+      m_MapFrames(true),
+      m_ReadbackThread(nullptr),
+      m_ReadbackRequestSemaphore(nullptr),
+      m_ReadbackDoneSemaphore(nullptr),
+      m_ReadbackSourceFrame(nullptr),
+      m_ReadbackResultFrame(nullptr),
+      m_ReadbackPending(false),
+      m_FrameIntervalMs(0),
+      m_VsyncPresent(false),
+      m_LastSwapStartTimeUs(0),
+      m_LastPresentTimeUs(0),
+      m_Overlay(new SdlOverlay())
 {
-    SDL_assert(TTF_WasInit() == 0);
-    if (TTF_Init() != 0) {
-        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                    "TTF_Init() failed: %s",
-                    TTF_GetError());
-        return;
-    }
-
-    SDL_zero(m_OverlayFonts);
-    SDL_zero(m_OverlaySurfaces);
-    SDL_zero(m_OverlayTextures);
+    SDL_AtomicSet(&m_ReadbackStopping, 0);
 }
 
 SdlRenderer::~SdlRenderer()
 {
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlayFonts[i] != nullptr) {
-            TTF_CloseFont(m_OverlayFonts[i]);
-        }
+    if (m_ReadbackThread != nullptr) {
+        SDL_AtomicSet(&m_ReadbackStopping, 1);
+        SDL_SemPost(m_ReadbackRequestSemaphore);
+        SDL_WaitThread(m_ReadbackThread, nullptr);
     }
 
-    TTF_Quit();
-    SDL_assert(TTF_WasInit() == 0);
-
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlayTextures[i] != nullptr) {
-            SDL_DestroyTexture(m_OverlayTextures[i]);
-        }
+    // Free anything left in the readback pipeline
+    if (m_ReadbackSourceFrame != nullptr) {
+        av_frame_free(&m_ReadbackSourceFrame);
+    }
+    if (m_ReadbackResultFrame != nullptr) {
+        m_ReadbackPool.put(m_ReadbackResultFrame);
     }
 
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlaySurfaces[i] != nullptr) {
-            SDL_FreeSurface(m_OverlaySurfaces[i]);
-        }
+    if (m_ReadbackRequestSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_ReadbackRequestSemaphore);
+    }
+    if (m_ReadbackDoneSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_ReadbackDoneSemaphore);
     }
 
+    // The overlay textures belong to m_Renderer
+    delete m_Overlay;
+
     if (m_Texture != nullptr) {
         SDL_DestroyTexture(m_Texture);
     }
@@ -71,43 +77,7 @@ bool SdlRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
 
 void SdlRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
 {
-    // Construct the required font to render the overlay
-    if (m_OverlayFonts[type] == nullptr) {
-        if (m_FontData.isEmpty()) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "SDL overlay font failed to load");
-            return;
-        }
-
-        // m_FontData must stay around until the font is closed
-        m_OverlayFonts[type] = TTF_OpenFontRW(SDL_RWFromConstMem(m_FontData.constData(), m_FontData.size()),
-                                              1,
-                                              Session::get()->getOverlayManager().getOverlayFontSize(type));
-        if (m_OverlayFonts[type] == nullptr) {
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "TTF_OpenFont() failed: %s",
-                        TTF_GetError());
-
-            // Can't proceed without a font
-            return;
-        }
-    }
-
-    SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
-
-    // Free the old surface
-    if (oldSurface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], oldSurface, nullptr)) {
-        SDL_FreeSurface(oldSurface);
-    }
-
-    if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // The _Wrapped variant is required for line breaks to work
-        SDL_Surface* surface = TTF_RenderText_Blended_Wrapped(m_OverlayFonts[type],
-                                                              Session::get()->getOverlayManager().getOverlayText(type),
-                                                              Session::get()->getOverlayManager().getOverlayColor(type),
-                                                              1000);
-        SDL_AtomicSetPtr((void**)&m_OverlaySurfaces[type], surface);
-    }
+    m_Overlay->notifyOverlayUpdated(type);
 }
 
 bool SdlRenderer::isRenderThreadSupported()
@@ -128,6 +98,12 @@ bool SdlRenderer::isRenderThreadSupported()
     return true;
 }
 
+void SdlRenderer::getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs)
+{
+    *swapStartTimeUs = m_LastSwapStartTimeUs;
+    *presentTimeUs = m_LastPresentTimeUs;
+}
+
 bool SdlRenderer::isPixelFormatSupported(int, AVPixelFormat pixelFormat)
 {
     // Remember to keep this in sync with SdlRenderer::renderFrame()!
@@ -177,6 +153,8 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
+    m_VsyncPresent = (rendererFlags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
     // SDL_CreateRenderer() can end up having to recreate our window (SDL_RecreateWindow())
     // to ensure it's compatible with the renderer's OpenGL context. If that happens, we
     // can get spurious SDL_WINDOWEVENT events that will cause us to (again) recreate our
@@ -212,100 +190,170 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
     SDL_SetHintWithPriority(SDL_HINT_VIDEO_MINIMIZE_ON_FOCUS_LOSS, "0", SDL_HINT_OVERRIDE);
 #endif
 
+    if (qEnvironmentVariableIntValue("READBACK_THREAD") != 0) {
+        // This adds a frame of latency in exchange for overlapping the readback
+        // of each frame with presenting the last one. Mapped frames are copied
+        // during the upload, so there would be nothing left to overlap.
+        m_MapFrames = false;
+        m_FrameIntervalMs = 1000 / params->frameRate;
+
+        m_ReadbackRequestSemaphore = SDL_CreateSemaphore(0);
+        m_ReadbackDoneSemaphore = SDL_CreateSemaphore(0);
+        if (m_ReadbackRequestSemaphore == nullptr || m_ReadbackDoneSemaphore == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Unable to create readback semaphores: %s",
+                         SDL_GetError());
+            return false;
+        }
+
+        m_ReadbackThread = SDL_CreateThread(readbackThread, "SdlReadback", this);
+        if (m_ReadbackThread == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Unable to create readback thread: %s",
+                         SDL_GetError());
+            return false;
+        }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Reading back frames on a separate thread (READBACK_THREAD)");
+    }
+
     return true;
 }
 
-void SdlRenderer::renderOverlay(Overlay::OverlayType type)
+// Called on the render thread, or the readback thread if there is one
+AVFrame* SdlRenderer::readBackFrame(AVFrame* frame)
 {
-    if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // If a new surface has been created for updated overlay data, convert it into a texture.
-        // NB: We have to do this conversion at render-time because we can only interact
-        // with the renderer on a single thread.
-        SDL_Surface* surface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
-        if (surface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], surface, nullptr)) {
-            if (m_OverlayTextures[type] != nullptr) {
-                SDL_DestroyTexture(m_OverlayTextures[type]);
-            }
+    FrameTrace::Span span("Readback");
+    AVFrame* swFrame;
+    int err;
 
-            if (type == Overlay::OverlayStatusUpdate) {
-                // Bottom Left
-                SDL_Rect viewportRect;
-                SDL_RenderGetViewport(m_Renderer, &viewportRect);
-                m_OverlayRects[type].x = 0;
-                m_OverlayRects[type].y = viewportRect.h - surface->h;
-            }
-            else if (type == Overlay::OverlayDebug) {
-                // Top left
-                m_OverlayRects[type].x = 0;
-                m_OverlayRects[type].y = 0;
-            }
+    // Find the native read-back format
+    if (m_SwPixelFormat == AV_PIX_FMT_NONE) {
+        auto hwFrameCtx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
 
-            m_OverlayRects[type].w = surface->w;
-            m_OverlayRects[type].h = surface->h;
+        m_SwPixelFormat = hwFrameCtx->sw_format;
+        SDL_assert(m_SwPixelFormat != AV_PIX_FMT_NONE);
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Selected read-back format: %d",
+                    m_SwPixelFormat);
+    }
 
-            m_OverlayTextures[type] = SDL_CreateTextureFromSurface(m_Renderer, surface);
-            SDL_FreeSurface(surface);
+    // Mapping the surface lets us copy straight from it into the texture
+    // instead of reading it back into another frame first. Not every
+    // hwaccel can map frames, so fall back to a transfer if it fails.
+    if (m_MapFrames) {
+        swFrame = av_frame_alloc();
+        if (swFrame == nullptr) {
+            return nullptr;
         }
 
-        // If we have an overlay texture, render it too
-        if (m_OverlayTextures[type] != nullptr) {
-            SDL_RenderCopy(m_Renderer, m_OverlayTextures[type], nullptr, &m_OverlayRects[type]);
+        swFrame->format = m_SwPixelFormat;
+        err = av_hwframe_map(swFrame, frame, AV_HWFRAME_MAP_READ);
+        if (err == 0) {
+            swFrame->colorspace = frame->colorspace;
+            return swFrame;
         }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "av_hwframe_map() failed: %d; using av_hwframe_transfer_data() instead",
+                    err);
+        m_MapFrames = false;
+        av_frame_free(&swFrame);
+    }
+
+    // Transfer into a frame that already has its buffers
+    swFrame = m_ReadbackPool.get(m_SwPixelFormat, frame->width, frame->height);
+    if (swFrame == nullptr) {
+        return nullptr;
+    }
+
+    err = av_hwframe_transfer_data(swFrame, frame, 0);
+    if (err != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "av_hwframe_transfer_data() failed: %d",
+                     err);
+        m_ReadbackPool.put(swFrame);
+        return nullptr;
     }
+
+    // av_hwframe_transfer_data() can nuke frame metadata,
+    // so anything other than width, height, and format must
+    // be set *after* calling av_hwframe_transfer_data().
+    swFrame->colorspace = frame->colorspace;
+
+    return swFrame;
 }
 
-void SdlRenderer::renderFrame(AVFrame* frame)
+// Called on the render thread. Starts reading back this frame and
+// returns the one read back during the last call, if any.
+AVFrame* SdlRenderer::exchangeReadbackFrame(AVFrame* frame)
 {
-    int err;
-    AVFrame* swFrame = nullptr;
+    AVFrame* readyFrame = nullptr;
 
-    if (frame == nullptr) {
-        // End of stream - nothing to do for us
-        return;
+    if (m_ReadbackPending) {
+        SDL_SemWait(m_ReadbackDoneSemaphore);
+        readyFrame = m_ReadbackResultFrame;
+        m_ReadbackResultFrame = nullptr;
+        m_ReadbackPending = false;
     }
 
-    if (frame->hw_frames_ctx != nullptr) {
-        // If we are acting as the frontend for a hardware
-        // accelerated decoder, we'll need to read the frame
-        // back to render it.
-
-        // Find the native read-back format
-        if (m_SwPixelFormat == AV_PIX_FMT_NONE) {
-            auto hwFrameCtx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
+    // Pacer frees the frame once we return, so keep our own
+    // reference to the hardware surface until it's read back
+    m_ReadbackSourceFrame = av_frame_clone(frame);
+    if (m_ReadbackSourceFrame != nullptr) {
+        m_ReadbackPending = true;
+        SDL_SemPost(m_ReadbackRequestSemaphore);
+    }
 
-            m_SwPixelFormat = hwFrameCtx->sw_format;
-            SDL_assert(m_SwPixelFormat != AV_PIX_FMT_NONE);
+    return readyFrame;
+}
 
-            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                        "Selected read-back format: %d",
-                        m_SwPixelFormat);
+int SdlRenderer::readbackThread(void* context)
+{
+    SdlRenderer* me = reinterpret_cast<SdlRenderer*>(context);
+
+    FrameTrace::setThreadName("SdlReadback");
+
+    bool resultWaiting = false;
+    for (;;) {
+        if (resultWaiting) {
+            if (SDL_SemWaitTimeout(me->m_ReadbackRequestSemaphore, me->m_FrameIntervalMs) != 0) {
+                // No new frame has come to push this one out, so have the
+                // main thread present it rather than leaving it unseen on
+                // a static screen. Render threads flush on their own.
+                SDL_Event event;
+                event.type = SDL_USEREVENT;
+                event.user.code = SDL_CODE_FRAME_READY;
+                SDL_PushEvent(&event);
+
+                resultWaiting = false;
+                continue;
+            }
         }
-
-        swFrame = av_frame_alloc();
-        if (swFrame == nullptr) {
-            return;
+        else {
+            SDL_SemWait(me->m_ReadbackRequestSemaphore);
         }
 
-        swFrame->width = frame->width;
-        swFrame->height = frame->height;
-        swFrame->format = m_SwPixelFormat;
-
-        err = av_hwframe_transfer_data(swFrame, frame, 0);
-        if (err != 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "av_hwframe_transfer_data() failed: %d",
-                         err);
-            goto Exit;
+        if (SDL_AtomicGet(&me->m_ReadbackStopping) != 0) {
+            break;
         }
 
-        // av_hwframe_transfer_data() can nuke frame metadata,
-        // so anything other than width, height, and format must
-        // be set *after* calling av_hwframe_transfer_data().
-        swFrame->colorspace = frame->colorspace;
+        me->m_ReadbackResultFrame = me->readBackFrame(me->m_ReadbackSourceFrame);
+        av_frame_free(&me->m_ReadbackSourceFrame);
 
-        frame = swFrame;
+        SDL_SemPost(me->m_ReadbackDoneSemaphore);
+        resultWaiting = true;
     }
 
+    return 0;
+}
+
+void SdlRenderer::presentFrame(AVFrame* frame)
+{
+    int err;
+
     if (m_Texture == nullptr) {
         Uint32 sdlFormat;
 
@@ -323,7 +371,7 @@ void SdlRenderer::renderFrame(AVFrame* frame)
             break;
         default:
             SDL_assert(false);
-            goto Exit;
+            return;
         }
 
 #if SDL_VERSION_ATLEAST(2,0,8)
@@ -349,7 +397,7 @@ void SdlRenderer::renderFrame(AVFrame* frame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "SDL_CreateTexture() failed: %s",
                          SDL_GetError());
-            goto Exit;
+            return;
         }
     }
 
@@ -371,15 +419,17 @@ void SdlRenderer::renderFrame(AVFrame* frame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "SDL_LockTexture() failed: %s",
                          SDL_GetError());
-            goto Exit;
+            return;
         }
 
-        memcpy(pixels,
-               frame->data[0],
-               frame->linesize[0] * frame->height);
-        memcpy(pixels + (frame->linesize[0] * frame->height),
-               frame->data[1],
-               frame->linesize[1] * frame->height / 2);
+        // The texture's pitch doesn't have to match the frame's. The
+        // interleaved chroma plane follows the luma plane at the same pitch.
+        PlaneCopy::copyPlane((Uint8*)pixels, pitch,
+                             frame->data[0], frame->linesize[0],
+                             frame->width, frame->height);
+        PlaneCopy::copyPlane((Uint8*)pixels + pitch * frame->height, pitch,
+                             frame->data[1], frame->linesize[1],
+                             (frame->width + 1) & ~1, (frame->height + 1) / 2);
 
         SDL_UnlockTexture(m_Texture);
     }
@@ -390,14 +440,71 @@ void SdlRenderer::renderFrame(AVFrame* frame)
     SDL_RenderCopy(m_Renderer, m_Texture, nullptr, nullptr);
 
     // Draw the overlays
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        renderOverlay((Overlay::OverlayType)i);
+    m_Overlay->render(m_Renderer);
+
+    {
+        FrameTrace::Span span("Swap");
+        m_LastSwapStartTimeUs = StreamUtils::getMicroseconds();
+        SDL_RenderPresent(m_Renderer);
+        if (m_VsyncPresent) {
+            m_LastPresentTimeUs = StreamUtils::getMicroseconds();
+        }
     }
+}
 
-    SDL_RenderPresent(m_Renderer);
+// Called on the render thread when Pacer has no new frame for us
+void SdlRenderer::flushPendingFrame()
+{
+    // Only present the pending frame if it's already read back, since
+    // a new frame may be on its way to replace it
+    if (!m_ReadbackPending || SDL_SemTryWait(m_ReadbackDoneSemaphore) != 0) {
+        return;
+    }
+
+    AVFrame* swFrame = m_ReadbackResultFrame;
+    m_ReadbackResultFrame = nullptr;
+    m_ReadbackPending = false;
 
-Exit:
     if (swFrame != nullptr) {
-        av_frame_free(&swFrame);
+        presentFrame(swFrame);
+        m_ReadbackPool.put(swFrame);
+    }
+}
+
+void SdlRenderer::renderFrame(AVFrame* frame)
+{
+    AVFrame* swFrame = nullptr;
+
+    m_LastSwapStartTimeUs = m_LastPresentTimeUs = 0;
+
+    if (frame == nullptr) {
+        // End of stream - nothing to do for us
+        return;
+    }
+
+    if (frame->hw_frames_ctx != nullptr) {
+        // If we are acting as the frontend for a hardware
+        // accelerated decoder, we'll need to read the frame
+        // back to render it.
+        if (m_ReadbackThread != nullptr) {
+            swFrame = exchangeReadbackFrame(frame);
+        }
+        else {
+            swFrame = readBackFrame(frame);
+        }
+
+        if (swFrame == nullptr) {
+            // The readback failed or the pipeline is still filling
+            return;
+        }
+
+        frame = swFrame;
+    }
+
+    presentFrame(frame);
+
+    if (swFrame != nullptr) {
+        // Pooled frames are recycled and mapped frames are unmapped
+        m_ReadbackPool.put(swFrame);
     }
 }
@@ -1,8 +1,8 @@
 #pragma once
 
 #include "renderer.h"
-
-#include <SDL_ttf.h>
+#include "swframepool.h"
+#include "streaming/video/sdloverlay.h"
 
 class SdlRenderer : public IFFmpegRenderer {
 public:
@@ -11,20 +11,40 @@ public:
     virtual bool initialize(PDECODER_PARAMETERS params) override;
     virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
     virtual void renderFrame(AVFrame* frame) override;
+    virtual void flushPendingFrame() override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
     virtual bool isRenderThreadSupported() override;
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+    virtual void getLastSwapTimes(Uint64* swapStartTimeUs, Uint64* presentTimeUs) override;
 
 private:
-    void renderOverlay(Overlay::OverlayType type);
+    void presentFrame(AVFrame* frame);
+
+    AVFrame* readBackFrame(AVFrame* frame);
+
+    AVFrame* exchangeReadbackFrame(AVFrame* frame);
+
+    static int readbackThread(void* context);
 
     SDL_Renderer* m_Renderer;
     SDL_Texture* m_Texture;
     int m_SwPixelFormat;
-    QByteArray m_FontData;
-    TTF_Font* m_OverlayFonts[Overlay::OverlayMax];
-    SDL_Surface* m_OverlaySurfaces[Overlay::OverlayMax];
-    SDL_Texture* m_OverlayTextures[Overlay::OverlayMax];
-    SDL_Rect m_OverlayRects[Overlay::OverlayMax];
+    bool m_MapFrames;
+    SwFramePool m_ReadbackPool;
+
+    // With READBACK_THREAD=1, the next frame is read back while
+    // the last one is uploaded and presented
+    SDL_Thread* m_ReadbackThread;
+    SDL_sem* m_ReadbackRequestSemaphore;
+    SDL_sem* m_ReadbackDoneSemaphore;
+    SDL_atomic_t m_ReadbackStopping;
+    AVFrame* m_ReadbackSourceFrame;
+    AVFrame* m_ReadbackResultFrame;
+    bool m_ReadbackPending;
+    Uint32 m_FrameIntervalMs;
+    bool m_VsyncPresent;
+    Uint64 m_LastSwapStartTimeUs;
+    Uint64 m_LastPresentTimeUs;
+    SdlOverlay* m_Overlay;
 };
 
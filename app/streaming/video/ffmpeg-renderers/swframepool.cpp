@@ -0,0 +1,98 @@
+#include "swframepool.h"
+
+SwFramePool::SwFramePool()
+    : m_Lock(0),
+      m_Format(AV_PIX_FMT_NONE),
+      m_Width(0),
+      m_Height(0),
+      m_FrameCount(0)
+{
+    SDL_zero(m_Frames);
+}
+
+SwFramePool::~SwFramePool()
+{
+    for (int i = 0; i < m_FrameCount; i++) {
+        av_frame_free(&m_Frames[i]);
+    }
+}
+
+AVFrame* SwFramePool::get(int format, int width, int height)
+{
+    AVFrame* staleFrames[SW_FRAME_POOL_SIZE];
+    int staleFrameCount = 0;
+    AVFrame* frame = nullptr;
+
+    SDL_AtomicLock(&m_Lock);
+
+    if (format != m_Format || width != m_Width || height != m_Height) {
+        // None of our frames fit anymore
+        for (int i = 0; i < m_FrameCount; i++) {
+            staleFrames[staleFrameCount++] = m_Frames[i];
+        }
+        m_FrameCount = 0;
+        m_Format = format;
+        m_Width = width;
+        m_Height = height;
+    }
+
+    if (m_FrameCount > 0) {
+        frame = m_Frames[--m_FrameCount];
+    }
+
+    SDL_AtomicUnlock(&m_Lock);
+
+    // Free outside the lock to keep it short
+    for (int i = 0; i < staleFrameCount; i++) {
+        av_frame_free(&staleFrames[i]);
+    }
+
+    if (frame != nullptr) {
+        return frame;
+    }
+
+    frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+
+    // Let FFmpeg pick the alignment its SIMD code wants for this CPU
+    int err = av_frame_get_buffer(frame, 0);
+    if (err < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "av_frame_get_buffer() failed: %d",
+                     err);
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    // Tag it so we know to take it back
+    frame->opaque = this;
+
+    return frame;
+}
+
+void SwFramePool::put(AVFrame* frame)
+{
+    if (frame->opaque == this) {
+        bool pooled = false;
+
+        SDL_AtomicLock(&m_Lock);
+        if (frame->format == m_Format && frame->width == m_Width && frame->height == m_Height &&
+                m_FrameCount < SW_FRAME_POOL_SIZE) {
+            m_Frames[m_FrameCount++] = frame;
+            pooled = true;
+        }
+        SDL_AtomicUnlock(&m_Lock);
+
+        if (pooled) {
+            return;
+        }
+    }
+
+    av_frame_free(&frame);
+}
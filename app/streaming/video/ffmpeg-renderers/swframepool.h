@@ -0,0 +1,35 @@
+#pragma once
+
+#include <SDL.h>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#define SW_FRAME_POOL_SIZE 4
+
+// Keeps software frames around with their buffers still allocated, so
+// reading back hardware frames doesn't allocate and free a frame's worth
+// of memory every time. Frames can be taken and returned on different
+// threads. Changing the format or size frees the pooled frames.
+class SwFramePool
+{
+public:
+    SwFramePool();
+    ~SwFramePool();
+
+    // Returns a frame with buffers for this format and size, or null on failure
+    AVFrame* get(int format, int width, int height);
+
+    // Keeps the frame for reuse if it came from us and still has
+    // the current format and size, otherwise frees it
+    void put(AVFrame* frame);
+
+private:
+    SDL_SpinLock m_Lock;
+    int m_Format;
+    int m_Width;
+    int m_Height;
+    AVFrame* m_Frames[SW_FRAME_POOL_SIZE];
+    int m_FrameCount;
+};
@@ -1,12 +1,19 @@
 #include <Limelight.h>
 #include "ffmpeg.h"
+#include "decoderprobecache.h"
+#include "frametrace.h"
+#include "videostats.h"
+#include "videosamples.h"
 #include "streaming/streamutils.h"
 #include "streaming/session.h"
 
 #include <h264_stream.h>
 
+#include <QSysInfo>
+
 #include "ffmpeg-renderers/sdlvid.h"
 #include "ffmpeg-renderers/cuda.h"
+#include "ffmpeg-renderers/null.h"
 
 #ifdef Q_OS_WIN32
 #include "ffmpeg-renderers/dxva2.h"
@@ -36,17 +43,19 @@
 #include "ffmpeg-renderers/eglvid.h"
 #endif
 
-// This is gross but it allows us to use sizeof()
-#include "ffmpeg_videosamples.cpp"
-
 #define MAX_SPS_EXTRA_SIZE 16
 
+// Consecutive decode failures before each step of recovery
+#define FAILED_DECODES_FLUSH_THRESHOLD 5
+#define FAILED_DECODES_RECREATE_THRESHOLD 10
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+SDL_atomic_t FFmpegVideoDecoder::s_ResetRecoveryStartTime;
+
 bool FFmpegVideoDecoder::isHardwareAccelerated()
 {
     return m_HwDecodeCfg != nullptr ||
-            (m_VideoDecoderCtx->codec->capabilities & AV_CODEC_CAP_HARDWARE) != 0;
+            (m_Decoder != nullptr && (m_Decoder->capabilities & AV_CODEC_CAP_HARDWARE) != 0);
 }
 
 bool FFmpegVideoDecoder::isAlwaysFullScreen()
@@ -118,23 +127,38 @@ enum AVPixelFormat FFmpegVideoDecoder::ffGetFormat(AVCodecContext* context,
 
 FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     : m_VideoDecoderCtx(nullptr),
-      m_DecodeBuffer(1024 * 1024, 0),
+      m_Decoder(nullptr),
+      m_FrameTimestampsPool(nullptr),
+      m_LastPacketPoolAllocations(0),
       m_HwDecodeCfg(nullptr),
       m_BackendRenderer(nullptr),
       m_FrontendRenderer(nullptr),
       m_ConsecutiveFailedDecodes(0),
+      m_RecoveryTier(-1),
+      m_RecoveryStartTime(0),
+      m_LastDecodedFrameTimeUs(0),
       m_Pacer(nullptr),
+      m_DecoderThread(nullptr),
+      m_DecodeQueueSemaphore(nullptr),
+      m_DropDecodeUnitsUntilIdr(false),
+      m_DecodeQueueDroppedFrames(0),
+      m_ActiveWndStartTime(0),
       m_FramesIn(0),
       m_FramesOut(0),
       m_LastFrameNumber(0),
       m_StreamFps(0),
       m_VideoFormat(0),
       m_NeedsSpsFixup(false),
+      m_ProbeCacheRevalidationPending(false),
       m_TestOnly(testOnly)
 {
     av_init_packet(&m_Pkt);
 
-    SDL_zero(m_ActiveWndVideoStats);
+    SDL_zero(m_DecoderParams);
+
+    SDL_AtomicSet(&m_DecoderThreadStopping, 0);
+    SDL_AtomicSet(&m_DecoderThreadNeedsIdr, 0);
+
     SDL_zero(m_LastWndVideoStats);
     SDL_zero(m_GlobalVideoStats);
 
@@ -160,6 +184,9 @@ IFFmpegRenderer* FFmpegVideoDecoder::getBackendRenderer()
 
 void FFmpegVideoDecoder::reset()
 {
+    // The decoder thread uses everything below, so it must stop first
+    stopDecoderThread();
+
     delete m_Pacer;
     m_Pacer = nullptr;
 
@@ -169,8 +196,13 @@ void FFmpegVideoDecoder::reset()
     // since the codec context may be referencing objects that we
     // need to delete in the renderer destructor.
     avcodec_free_context(&m_VideoDecoderCtx);
+    m_Decoder = nullptr;
 
-    if (!m_TestOnly) {
+    // Frames still holding timestamps release them back to the heap
+    av_buffer_pool_uninit(&m_FrameTimestampsPool);
+
+    // There's no session when replaying captured decode units
+    if (!m_TestOnly && Session::get() != nullptr) {
         Session::get()->getOverlayManager().setOverlayRenderer(nullptr);
     }
 
@@ -184,7 +216,10 @@ void FFmpegVideoDecoder::reset()
     m_FrontendRenderer = m_BackendRenderer = nullptr;
 
     if (!m_TestOnly) {
-        logVideoStats(m_GlobalVideoStats, "Global video stats");
+        // Everyone that records stats is gone by now
+        VIDEO_STATS globalStats;
+        getFinalVideoStats(globalStats);
+        logVideoStats(globalStats, "Global video stats");
     }
     else {
         // Test-only decoders can't have any frames submitted
@@ -194,6 +229,13 @@ void FFmpegVideoDecoder::reset()
 
 bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params)
 {
+    if (NullRenderer::isEnabled() && m_HwDecodeCfg != nullptr) {
+        // Discard hardware frames instead of presenting them. Software
+        // decoders already got a null renderer as their backend.
+        m_FrontendRenderer = new NullRenderer(m_BackendRenderer);
+        return m_FrontendRenderer->initialize(params);
+    }
+
 #ifdef HAVE_EGL
     if (m_BackendRenderer->canExportEGL()) {
         m_FrontendRenderer = new EGLRenderer(m_BackendRenderer);
@@ -235,12 +277,83 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
 
     // Don't bother initializing Pacer if we're not actually going to render
     if (!testFrame) {
-        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats);
+        m_Pacer = new Pacer(m_FrontendRenderer, &m_RenderStats, &m_VsyncStats);
         if (!m_Pacer->initialize(params->window, params->frameRate, params->enableFramePacing)) {
             return false;
         }
     }
 
+    if (!openDecoderContext(decoder, params)) {
+        return false;
+    }
+
+    // FFMpeg doesn't completely initialize the codec until the codec
+    // config data comes in. This would be too late for us to change
+    // our minds on the selected video codec, so we'll do a trial run
+    // now to see if things will actually work when the video stream
+    // comes in.
+    if (testFrame) {
+        switch (DecoderProbeCache::lookup(m_ProbeCacheKey)) {
+        case DecoderProbeCache::ProbePassed:
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Skipping test frame for previously working decoder: %s",
+                        qPrintable(m_ProbeCacheKey));
+            break;
+
+        case DecoderProbeCache::ProbeUnknown:
+            // Failures aren't cached, so a transient one
+            // doesn't keep us off this decoder next time
+            if (!decodeTestFrame(params->videoFormat)) {
+                return false;
+            }
+            DecoderProbeCache::storePassed(m_ProbeCacheKey);
+            break;
+        }
+    }
+    else {
+        m_PacketPool.initialize(params->width, params->height,
+                                params->frameRate, params->bitrate);
+        m_LastPacketPoolAllocations = m_PacketPool.getTotalAllocations();
+
+        m_FrameTimestampsPool = av_buffer_pool_init(sizeof(FRAME_TIMESTAMPS), nullptr);
+
+        if ((params->videoFormat & VIDEO_FORMAT_MASK_H264) &&
+                !(m_BackendRenderer->getDecoderCapabilities() & CAPABILITY_REFERENCE_FRAME_INVALIDATION_AVC)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using H.264 SPS fixup");
+            m_NeedsSpsFixup = true;
+        }
+        else {
+            m_NeedsSpsFixup = false;
+        }
+
+        // Software decoding can take long enough to stall packet reassembly
+        // if we decode on the receive thread, so software decoders get their
+        // own decoder thread by default. DECODE_THREAD=0/1 overrides this.
+        bool useDecoderThread = !isHardwareAccelerated();
+        if (qEnvironmentVariableIsSet("DECODE_THREAD")) {
+            useDecoderThread = qEnvironmentVariableIntValue("DECODE_THREAD") != 0;
+        }
+
+        if (useDecoderThread) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using separate decoder thread");
+            if (!startDecoderThread()) {
+                return false;
+            }
+        }
+
+        // Tell overlay manager to use this frontend renderer
+        if (Session::get() != nullptr) {
+            Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+        }
+    }
+
+    return true;
+}
+
+bool FFmpegVideoDecoder::openDecoderContext(AVCodec* decoder, PDECODER_PARAMETERS params)
+{
     m_VideoDecoderCtx = avcodec_alloc_context3(decoder);
     if (!m_VideoDecoderCtx) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -303,199 +416,98 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
         return false;
     }
 
-    // FFMpeg doesn't completely initialize the codec until the codec
-    // config data comes in. This would be too late for us to change
-    // our minds on the selected video codec, so we'll do a trial run
-    // now to see if things will actually work when the video stream
-    // comes in.
-    if (testFrame) {
-        switch (params->videoFormat) {
-        case VIDEO_FORMAT_H264:
-            m_Pkt.data = (uint8_t*)k_H264TestFrame;
-            m_Pkt.size = sizeof(k_H264TestFrame);
-            break;
-        case VIDEO_FORMAT_H265:
-            m_Pkt.data = (uint8_t*)k_HEVCMainTestFrame;
-            m_Pkt.size = sizeof(k_HEVCMainTestFrame);
-            break;
-        case VIDEO_FORMAT_H265_MAIN10:
-            m_Pkt.data = (uint8_t*)k_HEVCMain10TestFrame;
-            m_Pkt.size = sizeof(k_HEVCMain10TestFrame);
-            break;
-        default:
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "No test frame for format: %x",
-                         params->videoFormat);
-            return false;
-        }
+    // Keep what we need to recreate the context if decoding gets stuck
+    m_DecoderParams = *params;
 
-        AVFrame* frame = av_frame_alloc();
-        if (!frame) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Failed to allocate frame");
-            return false;
-        }
+    return true;
+}
 
-        // Some decoders won't output on the first frame, so we'll submit
-        // a few test frames if we get an EAGAIN error.
-        for (int retries = 0; retries < 5; retries++) {
-            // Most FFmpeg decoders process input using a "push" model.
-            // We'll see those fail here if the format is not supported.
-            err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
-            if (err < 0) {
-                av_frame_free(&frame);
-                char errorstring[512];
-                av_strerror(err, errorstring, sizeof(errorstring));
-                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                            "Test decode failed: %s", errorstring);
-                return false;
-            }
+bool FFmpegVideoDecoder::decodeTestFrame(int videoFormat)
+{
+    int err;
 
-            // A few FFmpeg decoders (h264_mmal) process here using a "pull" model.
-            // Those decoders will fail here if the format is not supported.
-            err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
-            if (err == AVERROR(EAGAIN)) {
-                // Wait a little while to let the hardware work
-                SDL_Delay(100);
-            }
-            else {
-                // Done!
-                break;
-            }
-        }
+    m_Pkt.data = (uint8_t*)VideoSamples::getTestFrame(videoFormat, &m_Pkt.size);
+    if (m_Pkt.data == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No test frame for format: %x",
+                     videoFormat);
+        return false;
+    }
 
-        av_frame_free(&frame);
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate frame");
+        return false;
+    }
+
+    // Some decoders won't output on the first frame, so we'll submit
+    // a few test frames if we get an EAGAIN error.
+    for (int retries = 0; retries < 5; retries++) {
+        // Most FFmpeg decoders process input using a "push" model.
+        // We'll see those fail here if the format is not supported.
+        err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
         if (err < 0) {
+            av_frame_free(&frame);
             char errorstring[512];
             av_strerror(err, errorstring, sizeof(errorstring));
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                         "Test decode failed: %s", errorstring);
             return false;
         }
-    }
-    else {
-        if ((params->videoFormat & VIDEO_FORMAT_MASK_H264) &&
-                !(m_BackendRenderer->getDecoderCapabilities() & CAPABILITY_REFERENCE_FRAME_INVALIDATION_AVC)) {
-            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                        "Using H.264 SPS fixup");
-            m_NeedsSpsFixup = true;
+
+        // A few FFmpeg decoders (h264_mmal) process here using a "pull" model.
+        // Those decoders will fail here if the format is not supported.
+        err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+        if (err == AVERROR(EAGAIN)) {
+            // Wait a little while to let the hardware work
+            SDL_Delay(100);
         }
         else {
-            m_NeedsSpsFixup = false;
+            // Done!
+            break;
         }
+    }
 
-        // Tell overlay manager to use this frontend renderer
-        Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+    av_frame_free(&frame);
+    if (err < 0) {
+        char errorstring[512];
+        av_strerror(err, errorstring, sizeof(errorstring));
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Test decode failed: %s", errorstring);
+        return false;
     }
 
     return true;
 }
 
-void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
+void FFmpegVideoDecoder::collectVideoStats(VIDEO_STATS& window)
 {
-    dst.receivedFrames += src.receivedFrames;
-    dst.decodedFrames += src.decodedFrames;
-    dst.renderedFrames += src.renderedFrames;
-    dst.totalFrames += src.totalFrames;
-    dst.networkDroppedFrames += src.networkDroppedFrames;
-    dst.pacerDroppedFrames += src.pacerDroppedFrames;
-    dst.totalReassemblyTime += src.totalReassemblyTime;
-    dst.totalDecodeTime += src.totalDecodeTime;
-    dst.totalPacerTime += src.totalPacerTime;
-    dst.totalRenderTime += src.totalRenderTime;
+    m_DecodeStats.collect(window);
+    m_RenderStats.collect(window);
+    m_VsyncStats.collect(window);
 
-    Uint32 now = SDL_GetTicks();
-
-    // Initialize the measurement start point if this is the first video stat window
-    if (!dst.measurementStartTimestamp) {
-        dst.measurementStartTimestamp = src.measurementStartTimestamp;
+    if (m_Pacer != nullptr) {
+        window.clockDriftKnown = m_Pacer->getClockDriftPpm(&window.clockDriftPpm);
     }
 
-    // The following code assumes the global measure was already started first
-    SDL_assert(dst.measurementStartTimestamp <= src.measurementStartTimestamp);
-
-    dst.totalFps = (float)dst.totalFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
-    dst.receivedFps = (float)dst.receivedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
-    dst.decodedFps = (float)dst.decodedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
-    dst.renderedFps = (float)dst.renderedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    window.measurementStartTimestamp = m_ActiveWndStartTime;
 }
 
 void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
 {
-    int offset = 0;
-    const char* codecString;
-
-    // Start with an empty string
-    output[offset] = 0;
-
-    switch (m_VideoFormat)
-    {
-    case VIDEO_FORMAT_H264:
-        codecString = "H.264";
-        break;
-
-    case VIDEO_FORMAT_H265:
-        codecString = "HEVC";
-        break;
-
-    case VIDEO_FORMAT_H265_MAIN10:
-        codecString = "HEVC Main 10";
-        break;
-
-    default:
-        SDL_assert(false);
-        codecString = "UNKNOWN";
-        break;
-    }
-
-    if (stats.receivedFps > 0) {
-        if (m_VideoDecoderCtx != nullptr) {
-            offset += sprintf(&output[offset],
-                              "Video stream: %dx%d %.2f FPS (Codec: %s)\n",
-                              m_VideoDecoderCtx->width,
-                              m_VideoDecoderCtx->height,
-                              stats.totalFps,
-                              codecString);
-        }
-
-        offset += sprintf(&output[offset],
-                          "Incoming frame rate from network: %.2f FPS\n"
-                          "Decoding frame rate: %.2f FPS\n"
-                          "Rendering frame rate: %.2f FPS\n",
-                          stats.receivedFps,
-                          stats.decodedFps,
-                          stats.renderedFps);
-    }
-
-    if (stats.renderedFrames != 0) {
-        offset += sprintf(&output[offset],
-                          "Frames dropped by your network connection: %.2f%%\n"
-                          "Frames dropped due to network jitter: %.2f%%\n"
-                          "Average receive time: %.2f ms\n"
-                          "Average decoding time: %.2f ms\n"
-                          "Average frame queue delay: %.2f ms\n"
-                          "Average rendering time (including monitor V-sync latency): %.2f ms\n",
-                          (float)stats.networkDroppedFrames / stats.totalFrames * 100,
-                          (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
-                          (float)stats.totalReassemblyTime / stats.receivedFrames,
-                          (float)stats.totalDecodeTime / stats.decodedFrames,
-                          (float)stats.totalPacerTime / stats.renderedFrames,
-                          (float)stats.totalRenderTime / stats.renderedFrames);
-    }
+    VideoStats::stringify(stats, m_VideoFormat,
+                          m_VideoDecoderCtx != nullptr ? m_VideoDecoderCtx->width : 0,
+                          m_VideoDecoderCtx != nullptr ? m_VideoDecoderCtx->height : 0,
+                          output);
 }
 
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
-    if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[512];
-        stringifyVideoStats(stats, videoStatsStr);
-
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "%s", title);
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "----------------------------------------------------------\n%s",
-                    videoStatsStr);
-    }
+    VideoStats::log(stats, m_VideoFormat,
+                    m_VideoDecoderCtx != nullptr ? m_VideoDecoderCtx->width : 0,
+                    m_VideoDecoderCtx != nullptr ? m_VideoDecoderCtx->height : 0,
+                    title);
 }
 
 IFFmpegRenderer* FFmpegVideoDecoder::createHwAccelRenderer(const AVCodecHWConfig* hwDecodeCfg, int pass)
@@ -545,26 +557,44 @@ IFFmpegRenderer* FFmpegVideoDecoder::createHwAccelRenderer(const AVCodecHWConfig
     }
 }
 
+IFFmpegRenderer* FFmpegVideoDecoder::createSoftwareRenderer()
+{
+    if (NullRenderer::isEnabled()) {
+        return new NullRenderer(nullptr);
+    }
+
+    return new SdlRenderer();
+}
+
 bool FFmpegVideoDecoder::tryInitializeRenderer(AVCodec* decoder,
                                                PDECODER_PARAMETERS params,
                                                const AVCodecHWConfig* hwConfig,
                                                std::function<IFFmpegRenderer*()> createRendererFunc)
 {
     m_BackendRenderer = createRendererFunc();
+    m_Decoder = decoder;
     m_HwDecodeCfg = hwConfig;
+    m_ProbeCacheKey = getProbeCacheKey(decoder, hwConfig, params);
+
+    // If this decoder has passed a test frame before, we can go straight to
+    // the real initialization. The first frames of the stream will tell us
+    // if that was a mistake.
+    bool knownWorking = DecoderProbeCache::lookup(m_ProbeCacheKey) == DecoderProbeCache::ProbePassed;
+    m_ProbeCacheRevalidationPending = knownWorking && !m_TestOnly;
 
     if (m_BackendRenderer != nullptr &&
             m_BackendRenderer->initialize(params) &&
-            completeInitialization(decoder, params, m_TestOnly || m_BackendRenderer->needsTestFrame())) {
+            completeInitialization(decoder, params, m_TestOnly || (m_BackendRenderer->needsTestFrame() && !knownWorking))) {
         if (m_TestOnly) {
             // This decoder is only for testing capabilities, so don't bother
             // creating a usable renderer
             return true;
         }
 
-        if (m_BackendRenderer->needsTestFrame()) {
+        if (m_BackendRenderer->needsTestFrame() && !knownWorking) {
             // The test worked, so now let's initialize it for real
             reset();
+            m_Decoder = decoder;
             if ((m_BackendRenderer = createRendererFunc()) != nullptr &&
                     m_BackendRenderer->initialize(params) &&
                     completeInitialization(decoder, params, false)) {
@@ -589,6 +619,38 @@ bool FFmpegVideoDecoder::tryInitializeRenderer(AVCodec* decoder,
     return false;
 }
 
+QString FFmpegVideoDecoder::getProbeCacheKey(AVCodec* decoder, const AVCodecHWConfig* hwConfig, PDECODER_PARAMETERS params)
+{
+    // Probe once per common resolution class rather than for every resolution
+    int maxDimension = qMax(params->width, params->height);
+    const char* resolutionBucket;
+    if (maxDimension <= 1280) {
+        resolutionBucket = "720p";
+    }
+    else if (maxDimension <= 1920) {
+        resolutionBucket = "1080p";
+    }
+    else if (maxDimension <= 2560) {
+        resolutionBucket = "1440p";
+    }
+    else {
+        resolutionBucket = "4K";
+    }
+
+    // The backend renderer is determined by the decoder and hwaccel type
+    // for a given build of Moonlight. We use the kernel version to catch
+    // driver and firmware updates.
+    return QString("%1|%2|%3|%4|%5|%6|%7|%8")
+            .arg(params->videoFormat, 0, 16)
+            .arg(resolutionBucket)
+            .arg(decoder->name)
+            .arg(hwConfig != nullptr ? av_hwdevice_get_type_name(hwConfig->device_type) : "none")
+            .arg(VERSION_STR)
+            .arg(av_version_info())
+            .arg(SDL_GetCurrentVideoDriver())
+            .arg(QSysInfo::kernelVersion());
+}
+
 bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 {
     // Increase log level until the first frame is decoded
@@ -609,7 +671,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (customAvcDecoder != nullptr &&
                     tryInitializeRenderer(customAvcDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          []() -> IFFmpegRenderer* { return createSoftwareRenderer(); })) {
                 SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                             "Using custom H.264 decoder (H264_DECODER_HINT): %s",
                             decoderString.constData());
@@ -630,7 +692,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (customHevcDecoder != nullptr &&
                     tryInitializeRenderer(customHevcDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          []() -> IFFmpegRenderer* { return createSoftwareRenderer(); })) {
                 SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                             "Using custom HEVC decoder (HEVC_DECODER_HINT): %s",
                             decoderString.constData());
@@ -728,7 +790,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (nvmpiDecoder != nullptr &&
                     tryInitializeRenderer(nvmpiDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          []() -> IFFmpegRenderer* { return createSoftwareRenderer(); })) {
                 return true;
             }
         }
@@ -745,7 +807,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (v4l2Decoder != nullptr &&
                     tryInitializeRenderer(v4l2Decoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          []() -> IFFmpegRenderer* { return createSoftwareRenderer(); })) {
                 return true;
             }
         }
@@ -771,8 +833,18 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     // Fallback to software if no matching hardware decoder was found
     // and if software fallback is allowed
     if (params->vds != StreamingPreferences::VDS_FORCE_HARDWARE) {
+#ifdef HAVE_EGL
+        // Let EGLRenderer upload the frames and convert them to RGB on the GPU,
+        // falling back to SdlRenderer if we can't get an OpenGL ES 3.0 context
+        if (EGLRenderer::isSoftwareUploadEnabled() && !NullRenderer::isEnabled() &&
+                tryInitializeRenderer(decoder, params, nullptr,
+                                      []() -> IFFmpegRenderer* { return new EGLRenderer(nullptr); })) {
+            return true;
+        }
+#endif
+
         if (tryInitializeRenderer(decoder, params, nullptr,
-                                  []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                  []() -> IFFmpegRenderer* { return createSoftwareRenderer(); })) {
             return true;
         }
     }
@@ -781,7 +853,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
-void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
+void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
         const char naluHeader[] = {0x00, 0x00, 0x00, 0x01};
@@ -806,18 +878,18 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
         // Copy the modified NALU data. This assumes a 3 byte prefix and
         // begins writing from the 2nd byte, so we must write the data
         // first, then go back and write the Annex B prefix.
-        offset += write_nal_unit(stream, (uint8_t*)&m_DecodeBuffer.data()[initialOffset + 3],
+        offset += write_nal_unit(stream, &buffer[initialOffset + 3],
                                  MAX_SPS_EXTRA_SIZE + entry->length - sizeof(naluHeader));
 
         // Copy the NALU prefix over from the original SPS
-        memcpy(&m_DecodeBuffer.data()[initialOffset], naluHeader, sizeof(naluHeader));
+        memcpy(&buffer[initialOffset], naluHeader, sizeof(naluHeader));
         offset += sizeof(naluHeader);
 
         h264_free(stream);
     }
     else {
         // Write the buffer as-is
-        memcpy(&m_DecodeBuffer.data()[offset],
+        memcpy(&buffer[offset],
                entry->data,
                entry->length);
         offset += entry->length;
@@ -826,45 +898,36 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 
 int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 {
-    PLENTRY entry = du->bufferList;
-    int err;
-
     SDL_assert(!m_TestOnly);
 
-    if (!m_LastFrameNumber) {
-        m_ActiveWndVideoStats.measurementStartTimestamp = SDL_GetTicks();
-        m_LastFrameNumber = du->frameNumber;
-    }
-    else {
-        // Any frame number greater than m_LastFrameNumber + 1 represents a dropped frame
-        m_ActiveWndVideoStats.networkDroppedFrames += du->frameNumber - (m_LastFrameNumber + 1);
-        m_ActiveWndVideoStats.totalFrames += du->frameNumber - (m_LastFrameNumber + 1);
-        m_LastFrameNumber = du->frameNumber;
+    if (FrameTrace::isEnabled()) {
+        // Show how long it took to receive the whole frame
+        Uint64 now = StreamUtils::getMicroseconds();
+        FrameTrace::addSpan("Receive", now - (LiGetMillis() - du->receiveTimeMs) * 1000, now, du->frameNumber);
     }
 
-    // Flip stats windows roughly every second
-    if (SDL_TICKS_PASSED(SDL_GetTicks(), m_ActiveWndVideoStats.measurementStartTimestamp + 1000)) {
-        // Update overlay stats if it's enabled
-        if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
-            VIDEO_STATS lastTwoWndStats = {};
-            addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
-            addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
-
-            stringifyVideoStats(lastTwoWndStats, Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug));
-            Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
-        }
+    FrameTrace::Span span("submitDecodeUnit", du->frameNumber);
 
-        // Accumulate these values into the global stats
-        addVideoStats(m_ActiveWndVideoStats, m_GlobalVideoStats);
+    if (m_DecoderThread != nullptr) {
+        return queueDecodeUnit(du);
+    }
 
-        // Move this window into the last window slot and clear it for next window
-        SDL_memcpy(&m_LastWndVideoStats, &m_ActiveWndVideoStats, sizeof(m_ActiveWndVideoStats));
-        SDL_zero(m_ActiveWndVideoStats);
-        m_ActiveWndVideoStats.measurementStartTimestamp = SDL_GetTicks();
+    PENDING_DECODE_UNIT pdu;
+    if (!preparePendingDecodeUnit(du, pdu)) {
+        return DR_NEED_IDR;
     }
 
-    m_ActiveWndVideoStats.receivedFrames++;
-    m_ActiveWndVideoStats.totalFrames++;
+    return decodePendingDecodeUnit(pdu, 0);
+}
+
+bool FFmpegVideoDecoder::preparePendingDecodeUnit(PDECODE_UNIT du, PENDING_DECODE_UNIT& pdu)
+{
+    PLENTRY entry = du->bufferList;
+
+    SDL_zero(pdu);
+    pdu.frameNumber = du->frameNumber;
+    pdu.frameType = du->frameType;
+    pdu.presentationTimeMs = du->presentationTimeMs;
 
     int requiredBufferSize = du->fullLength;
     if (du->frameType == FRAME_TYPE_IDR) {
@@ -872,48 +935,263 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    // Even single buffer decode units are copied. FFmpeg's bitstream readers
+    // may read up to AV_INPUT_BUFFER_PADDING_SIZE bytes past the end of the
+    // packet, and the depacketizer doesn't promise any zeroed padding there.
+    pdu.buffer = m_PacketPool.getBuffer(requiredBufferSize);
+    if (pdu.buffer == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to allocate packet buffer");
+        return false;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        writeBuffer(entry, offset);
+        writeBuffer(entry, pdu.buffer->data, offset);
         entry = entry->next;
     }
 
-    m_Pkt.data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
-    m_Pkt.size = offset;
+    // Pooled buffers are recycled, so clear any stale data from the padding
+    memset(&pdu.buffer->data[offset], 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
-    if (du->frameType == FRAME_TYPE_IDR) {
+    pdu.size = offset;
+    pdu.copiedBytes = offset;
+
+    // The pool only allocates when all of its buffers are in use by the decoder
+    Uint32 packetPoolAllocations = m_PacketPool.getTotalAllocations();
+    pdu.packetBufferAllocations = packetPoolAllocations - m_LastPacketPoolAllocations;
+    m_LastPacketPoolAllocations = packetPoolAllocations;
+
+    // The depacketizer only timestamps decode units in milliseconds,
+    // so convert its receive time to our microsecond clock.
+    Uint64 now = StreamUtils::getMicroseconds();
+    pdu.reassemblyTimeUs = (LiGetMillis() - du->receiveTimeMs) * 1000;
+    pdu.receiveTimeUs = now - pdu.reassemblyTimeUs;
+
+    return true;
+}
+
+int FFmpegVideoDecoder::queueDecodeUnit(PDECODE_UNIT du)
+{
+    // The decode thread can't return DR_NEED_IDR itself, so it asks us to
+    if (SDL_AtomicSet(&m_DecoderThreadNeedsIdr, 0) != 0) {
+        m_DropDecodeUnitsUntilIdr = true;
+        m_DecodeQueueDroppedFrames++;
+        return DR_NEED_IDR;
+    }
+
+    if (m_DropDecodeUnitsUntilIdr) {
+        if (du->frameType != FRAME_TYPE_IDR) {
+            // Frames before the next IDR frame can't be decoded correctly
+            m_DecodeQueueDroppedFrames++;
+            return DR_OK;
+        }
+
+        m_DropDecodeUnitsUntilIdr = false;
+    }
+
+    if (m_DecodeQueue.size() == DECODE_QUEUE_SIZE) {
+        // The decode thread has fallen too far behind. Rather than adding
+        // even more latency, throw this frame away and resync on an IDR frame.
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decode queue full; dropping frames until next IDR frame");
+        m_DropDecodeUnitsUntilIdr = true;
+        m_DecodeQueueDroppedFrames++;
+        return DR_NEED_IDR;
+    }
+
+    // The decode unit is freed when we return, so it must always be copied
+    PENDING_DECODE_UNIT pdu;
+    if (!preparePendingDecodeUnit(du, pdu)) {
+        m_DropDecodeUnitsUntilIdr = true;
+        m_DecodeQueueDroppedFrames++;
+        return DR_NEED_IDR;
+    }
+
+    // The decode thread accounts for the dropped frames along with this one
+    pdu.queueDroppedFrames = m_DecodeQueueDroppedFrames;
+    m_DecodeQueueDroppedFrames = 0;
+
+    // We checked for space above and we're the only producer
+    SDL_assert(m_DecodeQueue.size() < DECODE_QUEUE_SIZE);
+    m_DecodeQueue.push(pdu);
+    SDL_SemPost(m_DecodeQueueSemaphore);
+
+    return DR_OK;
+}
+
+int FFmpegVideoDecoder::decoderThreadProc(void* context)
+{
+    FFmpegVideoDecoder* me = reinterpret_cast<FFmpegVideoDecoder*>(context);
+
+    // Decoding is on the critical path between the network and the display
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    FrameTrace::setThreadName("FFDecoder");
+
+    for (;;) {
+        SDL_SemWait(me->m_DecodeQueueSemaphore);
+
+        if (SDL_AtomicGet(&me->m_DecoderThreadStopping) != 0) {
+            break;
+        }
+
+        PENDING_DECODE_UNIT pdu;
+        if (me->m_DecodeQueue.pop(pdu)) {
+            // Include the frame we just dequeued in the depth
+            if (me->decodePendingDecodeUnit(pdu, me->m_DecodeQueue.size() + 1) == DR_NEED_IDR) {
+                SDL_AtomicSet(&me->m_DecoderThreadNeedsIdr, 1);
+            }
+        }
+    }
+
+    return 0;
+}
+
+bool FFmpegVideoDecoder::startDecoderThread()
+{
+    SDL_AtomicSet(&m_DecoderThreadStopping, 0);
+    SDL_AtomicSet(&m_DecoderThreadNeedsIdr, 0);
+    m_DropDecodeUnitsUntilIdr = false;
+    m_DecodeQueueDroppedFrames = 0;
+
+    m_DecodeQueueSemaphore = SDL_CreateSemaphore(0);
+    if (m_DecodeQueueSemaphore == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode queue semaphore: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    m_DecoderThread = SDL_CreateThread(decoderThreadProc, "FFDecoder", this);
+    if (m_DecoderThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decoder thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void FFmpegVideoDecoder::stopDecoderThread()
+{
+    if (m_DecoderThread != nullptr) {
+        SDL_AtomicSet(&m_DecoderThreadStopping, 1);
+        SDL_SemPost(m_DecodeQueueSemaphore);
+        SDL_WaitThread(m_DecoderThread, nullptr);
+        m_DecoderThread = nullptr;
+    }
+
+    // Free any decode units that never made it to the decoder
+    PENDING_DECODE_UNIT pdu;
+    while (m_DecodeQueue.pop(pdu)) {
+        av_buffer_unref(&pdu.buffer);
+    }
+
+    if (m_DecodeQueueSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_DecodeQueueSemaphore);
+        m_DecodeQueueSemaphore = nullptr;
+    }
+}
+
+int FFmpegVideoDecoder::decodePendingDecodeUnit(PENDING_DECODE_UNIT& pdu, int queueDepth)
+{
+    int err;
+
+    if (m_VideoDecoderCtx == nullptr) {
+        // We failed to recreate the decoder context and we're waiting
+        // for the session to reset us.
+        av_buffer_unref(&pdu.buffer);
+        return DR_NEED_IDR;
+    }
+
+    m_DecodeStats.beginUpdate();
+
+    if (!m_LastFrameNumber) {
+        m_ActiveWndStartTime = SDL_GetTicks();
+        m_LastFrameNumber = pdu.frameNumber;
+    }
+    else {
+        // Any frame number greater than m_LastFrameNumber + 1 represents a dropped frame.
+        // Frames dropped from the decode queue were received, so don't blame the network.
+        int missingFrames = pdu.frameNumber - (m_LastFrameNumber + 1);
+        m_DecodeStats.add(VSC_NETWORK_DROPPED_FRAMES, missingFrames - pdu.queueDroppedFrames);
+        m_DecodeStats.add(VSC_TOTAL_FRAMES, missingFrames);
+        m_LastFrameNumber = pdu.frameNumber;
+    }
+
+    m_DecodeStats.add(VSC_RECEIVED_FRAMES, 1 + pdu.queueDroppedFrames);
+    m_DecodeStats.add(VSC_TOTAL_FRAMES, 1);
+    m_DecodeStats.add(VSC_DECODE_QUEUE_DROPPED_FRAMES, pdu.queueDroppedFrames);
+    m_DecodeStats.add(VSC_DECODE_QUEUE_DEPTH, queueDepth);
+    m_DecodeStats.add(VSC_PACKET_BUFFER_ALLOCATIONS, pdu.packetBufferAllocations);
+    m_DecodeStats.add(VSC_COPIED_BYTES, pdu.copiedBytes);
+    m_DecodeStats.record(VSS_REASSEMBLY, pdu.reassemblyTimeUs);
+
+    m_DecodeStats.endUpdate();
+
+    // Flip stats windows roughly every second. Pacer records its stats on
+    // other threads, so we roll up a snapshot rather than the live values.
+    if (SDL_TICKS_PASSED(SDL_GetTicks(), m_ActiveWndStartTime + 1000)) {
+        VIDEO_STATS activeWndStats = {};
+        collectVideoStats(activeWndStats);
+
+        // Update overlay stats if it's enabled
+        if (Session::get() != nullptr && Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+            VIDEO_STATS lastTwoWndStats = {};
+            VideoStats::add(m_LastWndVideoStats, lastTwoWndStats);
+            VideoStats::add(activeWndStats, lastTwoWndStats);
+
+            stringifyVideoStats(lastTwoWndStats, Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug));
+            Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
+        }
+
+        // Hand this window to the metrics exporter if it's enabled
+        if (Session::get() != nullptr && Session::get()->getMetricsExporter() != nullptr) {
+            VIDEO_STATS exportStats = {};
+            VideoStats::add(activeWndStats, exportStats);
+            Session::get()->getMetricsExporter()->submitVideoStats(exportStats,
+                                                                   m_Decoder->name,
+                                                                   m_VideoFormat);
+        }
+
+        // Accumulate these values into the global stats
+        VideoStats::add(activeWndStats, m_GlobalVideoStats);
+
+        // Move this window into the last window slot and start the next window
+        SDL_memcpy(&m_LastWndVideoStats, &activeWndStats, sizeof(activeWndStats));
+        m_ActiveWndStartTime = SDL_GetTicks();
+    }
+
+    // Hand our buffer reference over to the packet
+    m_Pkt.buf = pdu.buffer;
+    m_Pkt.data = pdu.buffer->data;
+    m_Pkt.size = pdu.size;
+    pdu.buffer = nullptr;
+
+    if (pdu.frameType == FRAME_TYPE_IDR) {
         m_Pkt.flags = AV_PKT_FLAG_KEY;
     }
     else {
         m_Pkt.flags = 0;
     }
 
-    m_ActiveWndVideoStats.totalReassemblyTime += LiGetMillis() - du->receiveTimeMs;
-
-    Uint32 beforeDecode = SDL_GetTicks();
+    Uint64 beforeDecode = StreamUtils::getMicroseconds();
 
-    err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
+    {
+        FrameTrace::Span span("avcodec_send_packet", pdu.frameNumber);
+        err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
+    }
     if (err < 0) {
+        releasePacket();
+
         char errorstring[512];
         av_strerror(err, errorstring, sizeof(errorstring));
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "avcodec_send_packet() failed: %s", errorstring);
 
-        // If we've failed a bunch of decodes in a row, the decoder/renderer is
-        // clearly unhealthy, so let's generate a synthetic reset event to trigger
-        // the event loop to destroy and recreate the decoder.
-        if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Resetting decoder due to consistent failure");
-
-            SDL_Event event;
-            event.type = SDL_RENDER_DEVICE_RESET;
-            SDL_PushEvent(&event);
-        }
-
+        recoverFromFailedDecode(err == AVERROR(EAGAIN));
         return DR_NEED_IDR;
     }
 
@@ -925,34 +1203,56 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         // so we can return DR_OK
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "Failed to allocate frame");
+        releasePacket();
         return DR_OK;
     }
 
-    err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+    {
+        FrameTrace::Span span("avcodec_receive_frame", pdu.frameNumber);
+        err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+    }
     if (err == 0) {
         m_FramesOut++;
 
         // Reset failed decodes count if we reached this far
         m_ConsecutiveFailedDecodes = 0;
+        completeRecovery();
+
+        if (m_ProbeCacheRevalidationPending) {
+            // Our cached test frame result held up, so keep it fresh
+            DecoderProbeCache::storePassed(m_ProbeCacheKey);
+            m_ProbeCacheRevalidationPending = false;
+        }
 
         // Restore default log level after a successful decode
         av_log_set_level(AV_LOG_INFO);
 
         // Store the presentation time
-        frame->pts = du->presentationTimeMs;
-
-        // Capture a frame timestamp to measuring pacing delay
-        frame->pkt_dts = SDL_GetTicks();
+        frame->pts = pdu.presentationTimeMs;
 
         // Count time in avcodec_send_packet() and avcodec_receive_frame()
-        // as time spent decoding
-        m_ActiveWndVideoStats.totalDecodeTime += SDL_GetTicks() - beforeDecode;
-
-        // Also count the frame-to-frame delay if the decoder is delaying frames
-        // until a subsequent frame is submitted.
-        m_ActiveWndVideoStats.totalDecodeTime += (m_FramesIn - m_FramesOut) * (1000 / m_StreamFps);
-
-        m_ActiveWndVideoStats.decodedFrames++;
+        // as time spent decoding. Also count the frame-to-frame delay if
+        // the decoder is delaying frames until a subsequent frame is submitted.
+        Uint64 afterDecode = StreamUtils::getMicroseconds();
+        m_DecodeStats.beginUpdate();
+        m_DecodeStats.record(VSS_DECODE, afterDecode - beforeDecode +
+                             (m_FramesIn - m_FramesOut) * (1000000 / m_StreamFps));
+        m_DecodeStats.add(VSC_DECODED_FRAMES, 1);
+        if (m_LastDecodedFrameTimeUs != 0) {
+            m_DecodeStats.record(VSS_DECODED_FRAME_INTERVAL, afterDecode - m_LastDecodedFrameTimeUs);
+        }
+        m_DecodeStats.endUpdate();
+        m_LastDecodedFrameTimeUs = afterDecode;
+
+        // Attach timestamps for Pacer to measure pacing delay
+        frame->opaque_ref = av_buffer_pool_get(m_FrameTimestampsPool);
+        if (frame->opaque_ref != nullptr) {
+            PFRAME_TIMESTAMPS timestamps = (PFRAME_TIMESTAMPS)frame->opaque_ref->data;
+            timestamps->receiveTimeUs = pdu.receiveTimeUs;
+            timestamps->decodeStartTimeUs = beforeDecode;
+            timestamps->decodeEndTimeUs = afterDecode;
+            timestamps->frameNumber = pdu.frameNumber;
+        }
 
         // Queue the frame for rendering (or render now if pacer is disabled)
         m_Pacer->submitFrame(frame);
@@ -965,17 +1265,173 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "avcodec_receive_frame() failed: %s", errorstring);
 
-        if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Resetting decoder due to consistent failure");
+        // The packet must be released before we touch the decoder context
+        releasePacket();
+        return recoverFromFailedDecode(err == AVERROR(EAGAIN)) ? DR_NEED_IDR : DR_OK;
+    }
 
-            SDL_Event event;
-            event.type = SDL_RENDER_DEVICE_RESET;
-            SDL_PushEvent(&event);
+    releasePacket();
+
+    return DR_OK;
+}
+
+bool FFmpegVideoDecoder::recreateDecoderContext()
+{
+    // The renderers and Pacer stay as they are. Frames that are still queued
+    // for rendering hold their own references to any hardware frames context.
+    avcodec_free_context(&m_VideoDecoderCtx);
+
+    if (!openDecoderContext(m_Decoder, &m_DecoderParams)) {
+        avcodec_free_context(&m_VideoDecoderCtx);
+        return false;
+    }
+
+    m_FramesIn = m_FramesOut = 0;
+    return true;
+}
+
+bool FFmpegVideoDecoder::recoverFromFailedDecode(bool wouldBlock)
+{
+    m_ConsecutiveFailedDecodes++;
+
+    // Decoders with a deep pipeline return EAGAIN until it fills, and
+    // flushing them would only start that over. Only a long run of
+    // EAGAIN means the decoder is stuck.
+    if (wouldBlock && m_ConsecutiveFailedDecodes < FAILED_DECODES_RESET_THRESHOLD) {
+        return false;
+    }
+
+    switch (m_ConsecutiveFailedDecodes) {
+    case FAILED_DECODES_FLUSH_THRESHOLD:
+        // Drop any bad state and references the decoder is holding
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Flushing decoder due to consistent failure");
+        avcodec_flush_buffers(m_VideoDecoderCtx);
+        m_FramesIn = m_FramesOut = 0;
+        beginRecovery(DECODER_RECOVERY_FLUSH);
+        return true;
+
+    case FAILED_DECODES_RECREATE_THRESHOLD:
+        // Start over with a new decoder, but keep our renderers since
+        // they are far more expensive to recreate.
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Recreating decoder due to consistent failure");
+        beginRecovery(DECODER_RECOVERY_RECREATE);
+        if (recreateDecoderContext()) {
+            return true;
         }
+
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to recreate decoder");
+        m_ConsecutiveFailedDecodes = FAILED_DECODES_RESET_THRESHOLD;
+        // Fall through
+
+    case FAILED_DECODES_RESET_THRESHOLD:
+    {
+        // If we've failed a bunch of decodes in a row, the decoder/renderer is
+        // clearly unhealthy, so let's generate a synthetic reset event to trigger
+        // the event loop to destroy and recreate the decoder.
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Resetting decoder due to consistent failure");
+
+        invalidateProbeCache();
+
+        // Our replacement will finish measuring this recovery
+        m_RecoveryTier = -1;
+        SDL_AtomicSet(&s_ResetRecoveryStartTime, (int)SDL_GetTicks());
+
+        SDL_Event event;
+        event.type = SDL_RENDER_DEVICE_RESET;
+        SDL_PushEvent(&event);
+        return true;
     }
 
-    return DR_OK;
+    default:
+        return false;
+    }
+}
+
+void FFmpegVideoDecoder::beginRecovery(int tier)
+{
+    m_RecoveryTier = tier;
+    m_RecoveryStartTime = SDL_GetTicks();
+}
+
+void FFmpegVideoDecoder::completeRecovery()
+{
+    static const VideoStatsCounter k_RecoveryCounters[DECODER_RECOVERY_TIERS][2] = {
+        { VSC_FLUSH_RECOVERIES, VSC_FLUSH_RECOVERY_TIME },
+        { VSC_RECREATE_RECOVERIES, VSC_RECREATE_RECOVERY_TIME },
+        { VSC_RESET_RECOVERIES, VSC_RESET_RECOVERY_TIME },
+    };
+    static const char* k_RecoveryTierNames[DECODER_RECOVERY_TIERS] = { "flush", "recreate", "reset" };
+
+    int tier = m_RecoveryTier;
+    Uint32 startTime = m_RecoveryStartTime;
+
+    if (tier < 0) {
+        // This may be the first frame since a previous decoder asked for a reset
+        Uint32 resetStartTime = (Uint32)SDL_AtomicGet(&s_ResetRecoveryStartTime);
+        if (resetStartTime == 0 ||
+                !SDL_AtomicCAS(&s_ResetRecoveryStartTime, (int)resetStartTime, 0)) {
+            return;
+        }
+
+        tier = DECODER_RECOVERY_RESET;
+        startTime = resetStartTime;
+    }
+    else {
+        SDL_AtomicSet(&s_ResetRecoveryStartTime, 0);
+    }
+
+    Uint32 recoveryTime = SDL_GetTicks() - startTime;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decoder recovered by %s in %u ms",
+                k_RecoveryTierNames[tier],
+                recoveryTime);
+
+    m_DecodeStats.beginUpdate();
+    m_DecodeStats.add(k_RecoveryCounters[tier][0], 1);
+    m_DecodeStats.add(k_RecoveryCounters[tier][1], recoveryTime);
+    m_DecodeStats.endUpdate();
+
+    m_RecoveryTier = -1;
+}
+
+void FFmpegVideoDecoder::invalidateProbeCache()
+{
+    if (m_ProbeCacheRevalidationPending) {
+        // We skipped the test frame and this decoder never produced a
+        // frame, so make the next launch test it again.
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Invalidating cached decoder probe result: %s",
+                    qPrintable(m_ProbeCacheKey));
+        DecoderProbeCache::remove(m_ProbeCacheKey);
+        m_ProbeCacheRevalidationPending = false;
+    }
+}
+
+void FFmpegVideoDecoder::releasePacket()
+{
+    av_buffer_unref(&m_Pkt.buf);
+    m_Pkt.data = nullptr;
+    m_Pkt.size = 0;
+}
+
+void FFmpegVideoDecoder::getFinalVideoStats(VIDEO_STATS& stats)
+{
+    // The decoder thread rolls up the stats windows while it runs
+    stopDecoderThread();
+
+    // Include the partial window since the last roll-up
+    if (m_ActiveWndStartTime != 0) {
+        VIDEO_STATS activeWndStats = {};
+        collectVideoStats(activeWndStats);
+        VideoStats::add(activeWndStats, m_GlobalVideoStats);
+        m_ActiveWndStartTime = 0;
+    }
+
+    SDL_memcpy(&stats, &m_GlobalVideoStats, sizeof(stats));
 }
 
 void FFmpegVideoDecoder::renderFrameOnMainThread()
@@ -3,6 +3,9 @@
 #include <functional>
 
 #include "decoder.h"
+#include "packetpool.h"
+#include "spscring.h"
+#include "videostatsshard.h"
 #include "ffmpeg-renderers/renderer.h"
 #include "ffmpeg-renderers/pacer/pacer.h"
 
@@ -10,6 +13,23 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// Must be a power of 2
+#define DECODE_QUEUE_SIZE 8
+
+// A decode unit that has been assembled into an FFmpeg packet buffer
+typedef struct _PENDING_DECODE_UNIT {
+    AVBufferRef* buffer;
+    int size;
+    int frameNumber;
+    int frameType;
+    uint32_t presentationTimeMs;
+    Uint64 receiveTimeUs;
+    Uint64 reassemblyTimeUs;
+    uint32_t packetBufferAllocations;
+    uint32_t copiedBytes;
+    uint32_t queueDroppedFrames;
+} PENDING_DECODE_UNIT;
+
 class FFmpegVideoDecoder : public IVideoDecoder {
 public:
     FFmpegVideoDecoder(bool testOnly);
@@ -22,17 +42,32 @@ public:
     virtual QSize getDecoderMaxResolution() override;
     virtual int submitDecodeUnit(PDECODE_UNIT du) override;
     virtual void renderFrameOnMainThread() override;
+    virtual void getFinalVideoStats(VIDEO_STATS& stats) override;
 
     virtual IFFmpegRenderer* getBackendRenderer();
 
 private:
     bool completeInitialization(AVCodec* decoder, PDECODER_PARAMETERS params, bool testFrame);
 
+    bool openDecoderContext(AVCodec* decoder, PDECODER_PARAMETERS params);
+
+    bool recreateDecoderContext();
+
+    bool recoverFromFailedDecode(bool wouldBlock);
+
+    void beginRecovery(int tier);
+
+    void completeRecovery();
+
+    bool decodeTestFrame(int videoFormat);
+
+    static QString getProbeCacheKey(AVCodec* decoder, const AVCodecHWConfig* hwConfig, PDECODER_PARAMETERS params);
+
     void stringifyVideoStats(VIDEO_STATS& stats, char* output);
 
     void logVideoStats(VIDEO_STATS& stats, const char* title);
 
-    void addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst);
+    void collectVideoStats(VIDEO_STATS& window);
 
     bool createFrontendRenderer(PDECODER_PARAMETERS params);
 
@@ -43,9 +78,27 @@ private:
 
     static IFFmpegRenderer* createHwAccelRenderer(const AVCodecHWConfig* hwDecodeCfg, int pass);
 
+    static IFFmpegRenderer* createSoftwareRenderer();
+
     void reset();
 
-    void writeBuffer(PLENTRY entry, int& offset);
+    void writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset);
+
+    void releasePacket();
+
+    void invalidateProbeCache();
+
+    bool preparePendingDecodeUnit(PDECODE_UNIT du, PENDING_DECODE_UNIT& pdu);
+
+    int decodePendingDecodeUnit(PENDING_DECODE_UNIT& pdu, int queueDepth);
+
+    int queueDecodeUnit(PDECODE_UNIT du);
+
+    bool startDecoderThread();
+
+    void stopDecoderThread();
+
+    static int decoderThreadProc(void* context);
 
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
@@ -53,13 +106,30 @@ private:
 
     AVPacket m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
-    QByteArray m_DecodeBuffer;
+    AVCodec* m_Decoder;
+    DECODER_PARAMETERS m_DecoderParams;
+    PacketPool m_PacketPool;
+    AVBufferPool* m_FrameTimestampsPool;
+    Uint32 m_LastPacketPoolAllocations;
     const AVCodecHWConfig* m_HwDecodeCfg;
     IFFmpegRenderer* m_BackendRenderer;
     IFFmpegRenderer* m_FrontendRenderer;
     int m_ConsecutiveFailedDecodes;
+    int m_RecoveryTier;
+    Uint32 m_RecoveryStartTime;
+    Uint64 m_LastDecodedFrameTimeUs;
     Pacer* m_Pacer;
-    VIDEO_STATS m_ActiveWndVideoStats;
+    SDL_Thread* m_DecoderThread;
+    SDL_sem* m_DecodeQueueSemaphore;
+    SpscRing<PENDING_DECODE_UNIT, DECODE_QUEUE_SIZE> m_DecodeQueue;
+    SDL_atomic_t m_DecoderThreadStopping;
+    SDL_atomic_t m_DecoderThreadNeedsIdr;
+    bool m_DropDecodeUnitsUntilIdr;
+    uint32_t m_DecodeQueueDroppedFrames;
+    VideoStatsShard m_DecodeStats;
+    VideoStatsShard m_RenderStats;
+    VideoStatsShard m_VsyncStats;
+    Uint32 m_ActiveWndStartTime;
     VIDEO_STATS m_LastWndVideoStats;
     VIDEO_STATS m_GlobalVideoStats;
 
@@ -70,9 +140,11 @@ private:
     int m_StreamFps;
     int m_VideoFormat;
     bool m_NeedsSpsFixup;
+    QString m_ProbeCacheKey;
+    bool m_ProbeCacheRevalidationPending;
     bool m_TestOnly;
 
-    static const uint8_t k_H264TestFrame[];
-    static const uint8_t k_HEVCMainTestFrame[];
-    static const uint8_t k_HEVCMain10TestFrame[];
+    // Set when we ask the session to replace us, so the next
+    // decoder can tell how long the full reset took
+    static SDL_atomic_t s_ResetRecoveryStartTime;
 };
@@ -0,0 +1,216 @@
+#include "frametrace.h"
+#include "streaming/streamutils.h"
+
+#include <QFile>
+
+#include <new>
+
+struct FrameTrace::ThreadRing {
+    SDL_threadID threadId;
+    char threadName[32];
+
+    // Only written by the owning thread
+    Uint32 totalSpans;
+    TRACE_SPAN spans[FRAME_TRACE_RING_SIZE];
+};
+
+std::atomic<bool> FrameTrace::s_Enabled(false);
+std::atomic<int> FrameTrace::s_ActiveWriters(0);
+FrameTrace::ThreadRing* FrameTrace::s_Rings;
+std::atomic<int> FrameTrace::s_RingsClaimed(0);
+std::atomic<int> FrameTrace::s_Generation(0);
+thread_local FrameTrace::ThreadRing* FrameTrace::s_ThreadRing;
+thread_local int FrameTrace::s_ThreadRingGeneration;
+
+FrameTrace::Span::Span(const char* name, int frameNumber)
+    : m_Name(name),
+      m_FrameNumber(frameNumber),
+      m_StartTimeUs(FrameTrace::isEnabled() ? StreamUtils::getMicroseconds() : 0)
+{
+
+}
+
+FrameTrace::Span::~Span()
+{
+    if (m_StartTimeUs != 0) {
+        FrameTrace::addSpan(m_Name, m_StartTimeUs, StreamUtils::getMicroseconds(), m_FrameNumber);
+    }
+}
+
+void FrameTrace::start()
+{
+    if (isEnabled()) {
+        return;
+    }
+
+    // Allocate every ring up front so recording a span never allocates
+    s_Rings = new (std::nothrow) ThreadRing[FRAME_TRACE_MAX_THREADS];
+    if (s_Rings == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to allocate frame trace buffers");
+        return;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Frame tracing enabled");
+
+    s_RingsClaimed = 0;
+    s_Generation++;
+    s_Enabled = true;
+}
+
+bool FrameTrace::beginWrite()
+{
+    // stop() clears s_Enabled before waiting for s_ActiveWriters to drain,
+    // so either we see tracing stopped here or stop() waits for us.
+    s_ActiveWriters++;
+    if (!s_Enabled) {
+        s_ActiveWriters--;
+        return false;
+    }
+
+    return true;
+}
+
+void FrameTrace::endWrite()
+{
+    s_ActiveWriters--;
+}
+
+FrameTrace::ThreadRing* FrameTrace::getThreadRing()
+{
+    int generation = s_Generation.load(std::memory_order_relaxed);
+    if (s_ThreadRingGeneration != generation) {
+        // This is the first span from this thread in this trace
+        int index = s_RingsClaimed++;
+        if (index < FRAME_TRACE_MAX_THREADS) {
+            ThreadRing* ring = &s_Rings[index];
+            ring->threadId = SDL_ThreadID();
+            SDL_snprintf(ring->threadName, sizeof(ring->threadName), "Thread %lu", ring->threadId);
+            ring->totalSpans = 0;
+            s_ThreadRing = ring;
+        }
+        else {
+            s_ThreadRing = nullptr;
+        }
+
+        s_ThreadRingGeneration = generation;
+    }
+
+    return s_ThreadRing;
+}
+
+void FrameTrace::setThreadName(const char* name)
+{
+    if (!isEnabled() || !beginWrite()) {
+        return;
+    }
+
+    ThreadRing* ring = getThreadRing();
+    if (ring != nullptr) {
+        SDL_strlcpy(ring->threadName, name, sizeof(ring->threadName));
+    }
+
+    endWrite();
+}
+
+void FrameTrace::addSpan(const char* name, Uint64 startTimeUs, Uint64 endTimeUs, int frameNumber)
+{
+    if (!isEnabled() || !beginWrite()) {
+        return;
+    }
+
+    ThreadRing* ring = getThreadRing();
+    if (ring != nullptr) {
+        TRACE_SPAN& span = ring->spans[ring->totalSpans % FRAME_TRACE_RING_SIZE];
+        span.name = name;
+        span.startTimeUs = startTimeUs;
+        span.durationUs = endTimeUs > startTimeUs ? (Uint32)(endTimeUs - startTimeUs) : 0;
+        span.frameNumber = frameNumber;
+        ring->totalSpans++;
+    }
+
+    endWrite();
+}
+
+void FrameTrace::stop(QString fileName)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    s_Enabled = false;
+
+    // Wait for threads that were in the middle of recording a span
+    while (s_ActiveWriters != 0) {
+        SDL_Delay(1);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open frame trace file %s: %s",
+                     qPrintable(fileName),
+                     qPrintable(file.errorString()));
+    }
+
+    QByteArray buffer;
+    bool first = true;
+
+    buffer.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int ringCount = SDL_min((int)s_RingsClaimed, FRAME_TRACE_MAX_THREADS);
+    for (int r = 0; r < ringCount; r++) {
+        ThreadRing* ring = &s_Rings[r];
+
+        buffer.append(QString("%1{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}\n")
+                      .arg(first ? "" : ",")
+                      .arg(ring->threadId)
+                      .arg(ring->threadName)
+                      .toUtf8());
+        first = false;
+
+        // Write the spans from oldest to newest
+        Uint32 firstSpan = ring->totalSpans > FRAME_TRACE_RING_SIZE ? ring->totalSpans - FRAME_TRACE_RING_SIZE : 0;
+        for (Uint32 i = firstSpan; i < ring->totalSpans; i++) {
+            const TRACE_SPAN& span = ring->spans[i % FRAME_TRACE_RING_SIZE];
+
+            char event[256];
+            if (span.frameNumber >= 0) {
+                SDL_snprintf(event, sizeof(event),
+                             ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%llu,\"dur\":%u,\"args\":{\"frame\":%d}}\n",
+                             span.name, ring->threadId, (unsigned long long)span.startTimeUs, span.durationUs, span.frameNumber);
+            }
+            else {
+                SDL_snprintf(event, sizeof(event),
+                             ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%llu,\"dur\":%u}\n",
+                             span.name, ring->threadId, (unsigned long long)span.startTimeUs, span.durationUs);
+            }
+            buffer.append(event);
+        }
+
+        // Don't let the buffer grow too large for low memory devices
+        if (file.isOpen()) {
+            file.write(buffer);
+        }
+        buffer.clear();
+    }
+
+    if (s_RingsClaimed > FRAME_TRACE_MAX_THREADS) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Dropped frame trace spans from %d threads",
+                    s_RingsClaimed - FRAME_TRACE_MAX_THREADS);
+    }
+
+    delete[] s_Rings;
+    s_Rings = nullptr;
+
+    buffer.append("]}\n");
+    if (file.isOpen()) {
+        file.write(buffer);
+        file.close();
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame trace written to %s",
+                    qPrintable(fileName));
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <atomic>
+
+#include <QString>
+
+// Number of spans kept per thread. Older spans are overwritten.
+#define FRAME_TRACE_RING_SIZE 32768
+
+// Number of threads that can record spans in a single trace. Spans from
+// any further threads are dropped.
+#define FRAME_TRACE_MAX_THREADS 8
+
+// Records what each thread spent its time on while a frame moves from the
+// network to the display. Each thread claims one of the rings allocated when
+// tracing starts and writes spans into it without locking. The rings are
+// written out in the Chrome trace event format (chrome://tracing or
+// ui.perfetto.dev) when tracing stops.
+class FrameTrace
+{
+public:
+    // Times a span on the calling thread from construction to destruction
+    class Span
+    {
+    public:
+        Span(const char* name, int frameNumber = -1);
+        ~Span();
+
+    private:
+        const char* m_Name;
+        int m_FrameNumber;
+        Uint64 m_StartTimeUs;
+    };
+
+    static void start();
+
+    // Stops recording and waits for any threads still writing a span
+    // before the rings are written out and freed
+    static void stop(QString fileName);
+
+    static bool isEnabled()
+    {
+        return s_Enabled.load(std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in the trace
+    static void setThreadName(const char* name);
+
+    // Records a span with explicit timestamps. name must be a string literal.
+    static void addSpan(const char* name, Uint64 startTimeUs, Uint64 endTimeUs, int frameNumber = -1);
+
+private:
+    typedef struct _TRACE_SPAN {
+        const char* name;
+        Uint64 startTimeUs;
+        Uint32 durationUs;
+        int frameNumber;
+    } TRACE_SPAN;
+
+    struct ThreadRing;
+
+    // Must be called between beginWrite() and endWrite()
+    static ThreadRing* getThreadRing();
+
+    // Returns false if tracing is stopped, in which case endWrite()
+    // must not be called
+    static bool beginWrite();
+    static void endWrite();
+
+    static std::atomic<bool> s_Enabled;
+    static std::atomic<int> s_ActiveWriters;
+
+    static ThreadRing* s_Rings;
+    static std::atomic<int> s_RingsClaimed;
+
+    // Rings are freed when tracing stops, so threads that outlive a
+    // trace must claim a new ring for the next one.
+    static std::atomic<int> s_Generation;
+    static thread_local ThreadRing* s_ThreadRing;
+    static thread_local int s_ThreadRingGeneration;
+};
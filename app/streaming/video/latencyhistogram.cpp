@@ -0,0 +1,123 @@
+#include "latencyhistogram.h"
+
+void LatencyHistogram::reset()
+{
+    SDL_zerop(this);
+}
+
+int LatencyHistogram::getBucketIndex(Uint64 valueUs)
+{
+    if (valueUs < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        // Small values get a bucket each
+        return (int)valueUs;
+    }
+    else if (valueUs > 0xFFFFFFFF) {
+        return LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+
+    int msb = 0;
+    for (Uint32 value = (Uint32)valueUs; value > 1; value >>= 1) {
+        msb++;
+    }
+
+    // The top bits below the MSB select the linear bucket within this power of two
+    int shift = msb - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    int subBucket = (int)(valueUs >> shift) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+Uint64 LatencyHistogram::getBucketUpperBound(int index)
+{
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = index / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+    Uint64 lowerBound = (Uint64)(LATENCY_HISTOGRAM_SUB_BUCKETS + index % LATENCY_HISTOGRAM_SUB_BUCKETS) << shift;
+
+    return lowerBound + ((Uint64)1 << shift) - 1;
+}
+
+void LatencyHistogram::record(Uint64 valueUs)
+{
+    m_Buckets[getBucketIndex(valueUs)]++;
+    m_Count++;
+    m_TotalUs += valueUs;
+    m_MaxUs = SDL_max(m_MaxUs, valueUs);
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        m_Buckets[i] += other.m_Buckets[i];
+    }
+
+    m_Count += other.m_Count;
+    m_TotalUs += other.m_TotalUs;
+    m_MaxUs = SDL_max(m_MaxUs, other.m_MaxUs);
+}
+
+Uint32 LatencyHistogram::getCount() const
+{
+    return m_Count;
+}
+
+float LatencyHistogram::getAverageMs() const
+{
+    if (m_Count == 0) {
+        return 0;
+    }
+
+    return (float)m_TotalUs / m_Count / 1000;
+}
+
+float LatencyHistogram::getPercentileMs(float percentile) const
+{
+    if (m_Count == 0) {
+        return 0;
+    }
+
+    // Find the bucket holding the sample with this rank
+    Uint32 rank = (Uint32)SDL_ceil((double)m_Count * percentile / 100);
+    rank = SDL_max(rank, 1);
+
+    Uint32 seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += m_Buckets[i];
+        if (seen >= rank) {
+            // Nothing in this bucket can be larger than the max we saw
+            return (float)SDL_min(getBucketUpperBound(i), m_MaxUs) / 1000;
+        }
+    }
+
+    return getMaxMs();
+}
+
+float LatencyHistogram::getMaxMs() const
+{
+    return (float)m_MaxUs / 1000;
+}
+
+float LatencyHistogram::getStdDevMs() const
+{
+    if (m_Count == 0) {
+        return 0;
+    }
+
+    double meanUs = (double)m_TotalUs / m_Count;
+    double sumOfSquaresUs = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (m_Buckets[i] == 0) {
+            continue;
+        }
+
+        // Place every sample in the middle of its bucket
+        Uint64 upperBound = getBucketUpperBound(i);
+        Uint64 lowerBound = i > 0 ? getBucketUpperBound(i - 1) + 1 : 0;
+        double deviationUs = (double)(lowerBound + upperBound) / 2 - meanUs;
+        sumOfSquaresUs += deviationUs * deviationUs * m_Buckets[i];
+    }
+
+    return (float)(SDL_sqrt(sumOfSquaresUs / m_Count) / 1000);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <SDL.h>
+
+// Each power of two is split into this many linear buckets, which
+// keeps every percentile within ~6% of the true value.
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 4
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Enough buckets for any 32-bit microsecond value (over an hour)
+#define LATENCY_HISTOGRAM_BUCKETS ((32 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+// A fixed-size log-linear histogram of latencies in microseconds.
+// It has no constructor or pointers, so it can be zeroed and copied
+// along with the rest of VIDEO_STATS.
+class LatencyHistogram
+{
+public:
+    void reset();
+
+    void record(Uint64 valueUs);
+
+    void add(const LatencyHistogram& other);
+
+    Uint32 getCount() const;
+
+    // Returns the average in milliseconds
+    float getAverageMs() const;
+
+    // Returns the given percentile (0-100) in milliseconds
+    float getPercentileMs(float percentile) const;
+
+    float getMaxMs() const;
+
+    // Returns the standard deviation in milliseconds, estimated from the buckets
+    float getStdDevMs() const;
+
+private:
+    // Rolls up histograms that are recorded with atomics
+    friend class VideoStatsShard;
+
+    static int getBucketIndex(Uint64 valueUs);
+
+    static Uint64 getBucketUpperBound(int index);
+
+    Uint32 m_Buckets[LATENCY_HISTOGRAM_BUCKETS];
+    Uint32 m_Count;
+    Uint64 m_TotalUs;
+    Uint64 m_MaxUs;
+};
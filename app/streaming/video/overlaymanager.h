@@ -38,7 +38,7 @@ public:
         bool enabled;
         int fontSize;
         SDL_Color color;
-        char text[512];
+        char text[2048];
     } m_Overlays[OverlayMax];
     IOverlayRenderer* m_Renderer;
 };
@@ -0,0 +1,73 @@
+#include "packetpool.h"
+#include "decodeunitsize.h"
+
+PacketPool::PacketPool()
+    : m_Pool(nullptr),
+      m_BufferSize(0),
+      m_TotalAllocations(0)
+{
+
+}
+
+PacketPool::~PacketPool()
+{
+    // Buffers still referenced by the decoder are freed when they are released
+    av_buffer_pool_uninit(&m_Pool);
+}
+
+void PacketPool::initialize(int width, int height, int frameRate, int bitrateKbps)
+{
+    resize(getDecodeUnitBufferSize(width, height, frameRate, bitrateKbps));
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Packet pool buffer size: %d KB",
+                m_BufferSize / 1024);
+}
+
+void PacketPool::resize(int bufferSize)
+{
+    // Outstanding buffers from the old pool are freed once the decoder
+    // drops its references to them.
+    av_buffer_pool_uninit(&m_Pool);
+
+    m_BufferSize = bufferSize;
+    m_Pool = av_buffer_pool_init2(m_BufferSize + AV_INPUT_BUFFER_PADDING_SIZE,
+                                  this, poolAlloc, nullptr);
+}
+
+AVBufferRef* PacketPool::poolAlloc(void* opaque, AVBufferSize size)
+{
+    PacketPool* me = reinterpret_cast<PacketPool*>(opaque);
+
+    // This is only called when the pool has no free buffers left
+    me->m_TotalAllocations++;
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef* PacketPool::getBuffer(int size)
+{
+    if (size > m_BufferSize) {
+        // Grow with some headroom so a run of large frames doesn't
+        // cause us to recreate the pool for each of them.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Growing packet pool for %d byte frame",
+                    size);
+        resize(size + size / 2);
+    }
+
+    if (m_Pool == nullptr) {
+        return nullptr;
+    }
+
+    return av_buffer_pool_get(m_Pool);
+}
+
+Uint32 PacketPool::getTotalAllocations()
+{
+    return m_TotalAllocations;
+}
+
+int PacketPool::getBufferSize()
+{
+    return m_BufferSize;
+}
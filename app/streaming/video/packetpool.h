@@ -0,0 +1,43 @@
+#pragma once
+
+#include <SDL.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+typedef size_t AVBufferSize;
+#else
+typedef int AVBufferSize;
+#endif
+
+// Hands out reference-counted, padded packet buffers from an AVBufferPool
+// so decode units can be assembled without a heap allocation per frame.
+// The buffers are sized from the negotiated stream parameters up front and
+// the pool is grown if a frame ever exceeds the current buffer size.
+class PacketPool
+{
+public:
+    PacketPool();
+
+    ~PacketPool();
+
+    void initialize(int width, int height, int frameRate, int bitrateKbps);
+
+    // Returns a buffer with at least size + AV_INPUT_BUFFER_PADDING_SIZE bytes
+    AVBufferRef* getBuffer(int size);
+
+    Uint32 getTotalAllocations();
+
+    int getBufferSize();
+
+private:
+    void resize(int bufferSize);
+
+    static AVBufferRef* poolAlloc(void* opaque, AVBufferSize size);
+
+    AVBufferPool* m_Pool;
+    int m_BufferSize;
+    Uint32 m_TotalAllocations;
+};
@@ -0,0 +1,282 @@
+#include "planecopy.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAVE_X86_KERNELS
+#include <emmintrin.h>
+#include <immintrin.h>
+
+// Let GCC and Clang build the AVX2 kernel without
+// requiring AVX2 for the rest of the binary
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+// Planes larger than this won't still be in the cache by the time
+// the GPU reads them, so writing them through the cache is wasted.
+// A 1080p luma plane stays just under it, while 4K planes go over.
+#define NON_TEMPORAL_THRESHOLD (2 * 1024 * 1024)
+
+static void copyRowsMemcpy(Uint8* dst, int dstPitch,
+                           const Uint8* src, int srcPitch,
+                           int widthBytes, int height)
+{
+    for (int y = 0; y < height; y++) {
+        memcpy(dst + (ptrdiff_t)y * dstPitch, src + (ptrdiff_t)y * srcPitch, widthBytes);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+TARGET_SSE2
+static void copyRowsSse2(Uint8* dst, int dstPitch,
+                         const Uint8* src, int srcPitch,
+                         int widthBytes, int height, bool nonTemporal)
+{
+    for (int y = 0; y < height; y++) {
+        Uint8* d = dst + (ptrdiff_t)y * dstPitch;
+        const Uint8* s = src + (ptrdiff_t)y * srcPitch;
+        int x = 0;
+
+        if (nonTemporal) {
+            // Streaming stores need an aligned destination
+            x = SDL_min((int)((16 - ((uintptr_t)d & 15)) & 15), widthBytes);
+            memcpy(d, s, x);
+
+            for (; x + 64 <= widthBytes; x += 64) {
+                __m128i v0 = _mm_loadu_si128((const __m128i*)(s + x));
+                __m128i v1 = _mm_loadu_si128((const __m128i*)(s + x + 16));
+                __m128i v2 = _mm_loadu_si128((const __m128i*)(s + x + 32));
+                __m128i v3 = _mm_loadu_si128((const __m128i*)(s + x + 48));
+                _mm_stream_si128((__m128i*)(d + x), v0);
+                _mm_stream_si128((__m128i*)(d + x + 16), v1);
+                _mm_stream_si128((__m128i*)(d + x + 32), v2);
+                _mm_stream_si128((__m128i*)(d + x + 48), v3);
+            }
+        }
+        else {
+            for (; x + 64 <= widthBytes; x += 64) {
+                __m128i v0 = _mm_loadu_si128((const __m128i*)(s + x));
+                __m128i v1 = _mm_loadu_si128((const __m128i*)(s + x + 16));
+                __m128i v2 = _mm_loadu_si128((const __m128i*)(s + x + 32));
+                __m128i v3 = _mm_loadu_si128((const __m128i*)(s + x + 48));
+                _mm_storeu_si128((__m128i*)(d + x), v0);
+                _mm_storeu_si128((__m128i*)(d + x + 16), v1);
+                _mm_storeu_si128((__m128i*)(d + x + 32), v2);
+                _mm_storeu_si128((__m128i*)(d + x + 48), v3);
+            }
+        }
+
+        for (; x + 16 <= widthBytes; x += 16) {
+            _mm_storeu_si128((__m128i*)(d + x), _mm_loadu_si128((const __m128i*)(s + x)));
+        }
+
+        memcpy(d + x, s + x, widthBytes - x);
+    }
+
+    if (nonTemporal) {
+        // Make the streaming stores visible before anyone reads the plane
+        _mm_sfence();
+    }
+}
+
+TARGET_AVX2
+static void copyRowsAvx2(Uint8* dst, int dstPitch,
+                         const Uint8* src, int srcPitch,
+                         int widthBytes, int height, bool nonTemporal)
+{
+    for (int y = 0; y < height; y++) {
+        Uint8* d = dst + (ptrdiff_t)y * dstPitch;
+        const Uint8* s = src + (ptrdiff_t)y * srcPitch;
+        int x = 0;
+
+        if (nonTemporal) {
+            // Streaming stores need an aligned destination
+            x = SDL_min((int)((32 - ((uintptr_t)d & 31)) & 31), widthBytes);
+            memcpy(d, s, x);
+
+            for (; x + 128 <= widthBytes; x += 128) {
+                __m256i v0 = _mm256_loadu_si256((const __m256i*)(s + x));
+                __m256i v1 = _mm256_loadu_si256((const __m256i*)(s + x + 32));
+                __m256i v2 = _mm256_loadu_si256((const __m256i*)(s + x + 64));
+                __m256i v3 = _mm256_loadu_si256((const __m256i*)(s + x + 96));
+                _mm256_stream_si256((__m256i*)(d + x), v0);
+                _mm256_stream_si256((__m256i*)(d + x + 32), v1);
+                _mm256_stream_si256((__m256i*)(d + x + 64), v2);
+                _mm256_stream_si256((__m256i*)(d + x + 96), v3);
+            }
+        }
+        else {
+            for (; x + 128 <= widthBytes; x += 128) {
+                __m256i v0 = _mm256_loadu_si256((const __m256i*)(s + x));
+                __m256i v1 = _mm256_loadu_si256((const __m256i*)(s + x + 32));
+                __m256i v2 = _mm256_loadu_si256((const __m256i*)(s + x + 64));
+                __m256i v3 = _mm256_loadu_si256((const __m256i*)(s + x + 96));
+                _mm256_storeu_si256((__m256i*)(d + x), v0);
+                _mm256_storeu_si256((__m256i*)(d + x + 32), v1);
+                _mm256_storeu_si256((__m256i*)(d + x + 64), v2);
+                _mm256_storeu_si256((__m256i*)(d + x + 96), v3);
+            }
+        }
+
+        for (; x + 32 <= widthBytes; x += 32) {
+            _mm256_storeu_si256((__m256i*)(d + x), _mm256_loadu_si256((const __m256i*)(s + x)));
+        }
+
+        memcpy(d + x, s + x, widthBytes - x);
+    }
+
+    if (nonTemporal) {
+        // Make the streaming stores visible before anyone reads the plane
+        _mm_sfence();
+    }
+}
+
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+
+// NEON has no streaming stores, so this always goes through the cache
+static void copyRowsNeon(Uint8* dst, int dstPitch,
+                         const Uint8* src, int srcPitch,
+                         int widthBytes, int height)
+{
+    for (int y = 0; y < height; y++) {
+        Uint8* d = dst + (ptrdiff_t)y * dstPitch;
+        const Uint8* s = src + (ptrdiff_t)y * srcPitch;
+        int x = 0;
+
+        for (; x + 64 <= widthBytes; x += 64) {
+            uint8x16_t v0 = vld1q_u8(s + x);
+            uint8x16_t v1 = vld1q_u8(s + x + 16);
+            uint8x16_t v2 = vld1q_u8(s + x + 32);
+            uint8x16_t v3 = vld1q_u8(s + x + 48);
+            vst1q_u8(d + x, v0);
+            vst1q_u8(d + x + 16, v1);
+            vst1q_u8(d + x + 32, v2);
+            vst1q_u8(d + x + 48, v3);
+        }
+
+        for (; x + 16 <= widthBytes; x += 16) {
+            vst1q_u8(d + x, vld1q_u8(s + x));
+        }
+
+        memcpy(d + x, s + x, widthBytes - x);
+    }
+}
+
+#endif
+
+static PlaneCopyKernel selectBestKernel()
+{
+    static const PlaneCopyKernel k_KernelPreference[] = { PCK_AVX2, PCK_SSE2, PCK_NEON };
+
+    for (PlaneCopyKernel kernel : k_KernelPreference) {
+        if (PlaneCopy::isKernelSupported(kernel)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using %s plane copy",
+                        PlaneCopy::getKernelName(kernel));
+            return kernel;
+        }
+    }
+
+    return PCK_MEMCPY;
+}
+
+bool PlaneCopy::isKernelSupported(PlaneCopyKernel kernel)
+{
+    switch (kernel) {
+    case PCK_MEMCPY:
+        return true;
+#ifdef HAVE_X86_KERNELS
+    case PCK_SSE2:
+        return SDL_HasSSE2();
+    case PCK_AVX2:
+        return SDL_HasAVX2();
+#endif
+#ifdef HAVE_NEON_KERNELS
+    case PCK_NEON:
+        // We're only built with NEON if the target always has it
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* PlaneCopy::getKernelName(PlaneCopyKernel kernel)
+{
+    switch (kernel) {
+    case PCK_MEMCPY:
+        return "memcpy";
+    case PCK_SSE2:
+        return "SSE2";
+    case PCK_AVX2:
+        return "AVX2";
+    case PCK_NEON:
+        return "NEON";
+    default:
+        return "unknown";
+    }
+}
+
+void PlaneCopy::copyPlane(Uint8* dst, int dstPitch,
+                          const Uint8* src, int srcPitch,
+                          int widthBytes, int height)
+{
+    static const PlaneCopyKernel s_BestKernel = selectBestKernel();
+
+    bool nonTemporal = (Sint64)widthBytes * height > NON_TEMPORAL_THRESHOLD;
+
+    if (!nonTemporal && dstPitch == widthBytes && srcPitch == widthBytes) {
+        // Nothing to skip between lines, so this is one big copy
+        memcpy(dst, src, (size_t)widthBytes * height);
+        return;
+    }
+
+    copyPlane(s_BestKernel, nonTemporal, dst, dstPitch, src, srcPitch, widthBytes, height);
+}
+
+void PlaneCopy::copyPlane(PlaneCopyKernel kernel, bool nonTemporal,
+                          Uint8* dst, int dstPitch,
+                          const Uint8* src, int srcPitch,
+                          int widthBytes, int height)
+{
+    SDL_assert(isKernelSupported(kernel));
+
+    if (widthBytes <= 0 || height <= 0) {
+        return;
+    }
+
+    switch (kernel) {
+#ifdef HAVE_X86_KERNELS
+    case PCK_SSE2:
+        copyRowsSse2(dst, dstPitch, src, srcPitch, widthBytes, height, nonTemporal);
+        break;
+    case PCK_AVX2:
+        copyRowsAvx2(dst, dstPitch, src, srcPitch, widthBytes, height, nonTemporal);
+        break;
+#endif
+#ifdef HAVE_NEON_KERNELS
+    case PCK_NEON:
+        copyRowsNeon(dst, dstPitch, src, srcPitch, widthBytes, height);
+        break;
+#endif
+    default:
+        copyRowsMemcpy(dst, dstPitch, src, srcPitch, widthBytes, height);
+        break;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <SDL.h>
+
+enum PlaneCopyKernel {
+    PCK_MEMCPY,
+    PCK_SSE2,
+    PCK_AVX2,
+    PCK_NEON,
+    PCK_MAX
+};
+
+// Copies image planes between buffers whose pitches may differ, such as
+// from a decoded frame into a locked texture. Only the visible part of
+// each line is copied. Large planes are written with non-temporal stores
+// where the CPU has them, so they don't evict everything else from the
+// cache on their way to the GPU.
+class PlaneCopy
+{
+public:
+    // Uses the fastest kernel this CPU supports
+    static
+    void copyPlane(Uint8* dst, int dstPitch,
+                   const Uint8* src, int srcPitch,
+                   int widthBytes, int height);
+
+    // For benchmarking the kernels against each other
+    static
+    void copyPlane(PlaneCopyKernel kernel, bool nonTemporal,
+                   Uint8* dst, int dstPitch,
+                   const Uint8* src, int srcPitch,
+                   int widthBytes, int height);
+
+    static
+    bool isKernelSupported(PlaneCopyKernel kernel);
+
+    static
+    const char* getKernelName(PlaneCopyKernel kernel);
+};
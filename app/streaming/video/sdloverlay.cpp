@@ -0,0 +1,126 @@
+#include "sdloverlay.h"
+
+#include "streaming/session.h"
+#include "path.h"
+
+SdlOverlay::SdlOverlay()
+    : m_FontData(Path::readDataFile("ModeSeven.ttf"))
+{
+    SDL_zero(m_OverlayFonts);
+    SDL_zero(m_OverlaySurfaces);
+    SDL_zero(m_OverlayTextures);
+    SDL_zero(m_OverlayRects);
+
+    if (TTF_Init() != 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "TTF_Init() failed: %s",
+                    TTF_GetError());
+    }
+}
+
+SdlOverlay::~SdlOverlay()
+{
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        if (m_OverlayFonts[i] != nullptr) {
+            TTF_CloseFont(m_OverlayFonts[i]);
+        }
+        if (m_OverlayTextures[i] != nullptr) {
+            SDL_DestroyTexture(m_OverlayTextures[i]);
+        }
+        if (m_OverlaySurfaces[i] != nullptr) {
+            SDL_FreeSurface(m_OverlaySurfaces[i]);
+        }
+    }
+
+    if (TTF_WasInit()) {
+        TTF_Quit();
+    }
+}
+
+void SdlOverlay::notifyOverlayUpdated(Overlay::OverlayType type)
+{
+    // Construct the required font to render the overlay
+    if (m_OverlayFonts[type] == nullptr) {
+        if (m_FontData.isEmpty()) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL overlay font failed to load");
+            return;
+        }
+
+        // m_FontData must stay around until the font is closed
+        m_OverlayFonts[type] = TTF_OpenFontRW(SDL_RWFromConstMem(m_FontData.constData(), m_FontData.size()),
+                                              1,
+                                              Session::get()->getOverlayManager().getOverlayFontSize(type));
+        if (m_OverlayFonts[type] == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "TTF_OpenFont() failed: %s",
+                        TTF_GetError());
+
+            // Can't proceed without a font
+            return;
+        }
+    }
+
+    SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
+
+    // Free the old surface
+    if (oldSurface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], oldSurface, nullptr)) {
+        SDL_FreeSurface(oldSurface);
+    }
+
+    if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        // The _Wrapped variant is required for line breaks to work
+        SDL_Surface* surface = TTF_RenderText_Blended_Wrapped(m_OverlayFonts[type],
+                                                              Session::get()->getOverlayManager().getOverlayText(type),
+                                                              Session::get()->getOverlayManager().getOverlayColor(type),
+                                                              1000);
+        SDL_AtomicSetPtr((void**)&m_OverlaySurfaces[type], surface);
+    }
+}
+
+void SdlOverlay::render(SDL_Renderer* renderer)
+{
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        renderOverlay(renderer, (Overlay::OverlayType)i);
+    }
+}
+
+void SdlOverlay::renderOverlay(SDL_Renderer* renderer, Overlay::OverlayType type)
+{
+    // There's no session when replaying captured decode units
+    if (Session::get() != nullptr && Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        // If a new surface has been created for updated overlay data, convert it into a texture.
+        // NB: We have to do this conversion at render-time because we can only interact
+        // with the renderer on a single thread.
+        SDL_Surface* surface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
+        if (surface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], surface, nullptr)) {
+            if (m_OverlayTextures[type] != nullptr) {
+                SDL_DestroyTexture(m_OverlayTextures[type]);
+            }
+
+            if (type == Overlay::OverlayStatusUpdate) {
+                // Bottom Left
+                SDL_Rect viewportRect;
+                SDL_RenderGetViewport(renderer, &viewportRect);
+                m_OverlayRects[type].x = 0;
+                m_OverlayRects[type].y = viewportRect.h - surface->h;
+            }
+            else if (type == Overlay::OverlayDebug) {
+                // Top left
+                m_OverlayRects[type].x = 0;
+                m_OverlayRects[type].y = 0;
+            }
+
+            m_OverlayRects[type].w = surface->w;
+            m_OverlayRects[type].h = surface->h;
+
+            m_OverlayTextures[type] = SDL_CreateTextureFromSurface(renderer, surface);
+            SDL_FreeSurface(surface);
+        }
+
+        // If we have an overlay texture, render it too
+        if (m_OverlayTextures[type] != nullptr) {
+            SDL_RenderCopy(renderer, m_OverlayTextures[type], nullptr, &m_OverlayRects[type]);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "overlaymanager.h"
+
+#include <SDL_ttf.h>
+
+#include <QByteArray>
+
+// Rasterizes the session's overlays with SDL_ttf and draws them with an
+// SDL_Renderer. Shared by the renderers that draw through SDL.
+class SdlOverlay
+{
+public:
+    SdlOverlay();
+
+    // Must be deleted before the renderer that drew the overlays
+    ~SdlOverlay();
+
+    // Called on any thread when the overlay text changes
+    void notifyOverlayUpdated(Overlay::OverlayType type);
+
+    // Called on the render thread to draw every enabled overlay
+    void render(SDL_Renderer* renderer);
+
+private:
+    void renderOverlay(SDL_Renderer* renderer, Overlay::OverlayType type);
+
+    QByteArray m_FontData;
+    TTF_Font* m_OverlayFonts[Overlay::OverlayMax];
+    SDL_Surface* m_OverlaySurfaces[Overlay::OverlayMax];
+    SDL_Texture* m_OverlayTextures[Overlay::OverlayMax];
+    SDL_Rect m_OverlayRects[Overlay::OverlayMax];
+};
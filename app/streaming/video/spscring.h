@@ -0,0 +1,74 @@
+#pragma once
+
+#include <SDL.h>
+
+// Bounded lock-free ring buffer for passing items from exactly one
+// producer thread to exactly one consumer thread. Only the producer
+// may call push() and only the consumer may call pop().
+template <typename T, int Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of 2");
+
+public:
+    SpscRing()
+    {
+        SDL_AtomicSet(&m_Head, 0);
+        SDL_AtomicSet(&m_Tail, 0);
+    }
+
+    bool push(const T& item)
+    {
+        unsigned int tail = (unsigned int)SDL_AtomicGet(&m_Tail);
+
+        if (tail - (unsigned int)SDL_AtomicGet(&m_Head) == Capacity) {
+            return false;
+        }
+
+        m_Items[tail & (Capacity - 1)] = item;
+
+        // Publish the item to the consumer
+        SDL_AtomicSet(&m_Tail, (int)(tail + 1));
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        unsigned int head = (unsigned int)SDL_AtomicGet(&m_Head);
+
+        if (head == (unsigned int)SDL_AtomicGet(&m_Tail)) {
+            return false;
+        }
+
+        item = m_Items[head & (Capacity - 1)];
+
+        // Hand the slot back to the producer
+        SDL_AtomicSet(&m_Head, (int)(head + 1));
+        return true;
+    }
+
+    // Only the consumer may call this. Leaves the item in the ring.
+    bool peek(T& item)
+    {
+        unsigned int head = (unsigned int)SDL_AtomicGet(&m_Head);
+
+        if (head == (unsigned int)SDL_AtomicGet(&m_Tail)) {
+            return false;
+        }
+
+        item = m_Items[head & (Capacity - 1)];
+        return true;
+    }
+
+    // Only exact when called from the producer or consumer thread
+    int size()
+    {
+        return (int)((unsigned int)SDL_AtomicGet(&m_Tail) - (unsigned int)SDL_AtomicGet(&m_Head));
+    }
+
+private:
+    T m_Items[Capacity];
+    SDL_atomic_t m_Head;
+    SDL_atomic_t m_Tail;
+};
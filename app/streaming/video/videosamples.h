@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL.h>
+
+// Single frame streams for checking that a decoder can really decode a
+// format, rather than just claiming to support it
+class VideoSamples
+{
+public:
+    // Returns nullptr if we don't have a frame for this format
+    static const Uint8* getTestFrame(int videoFormat, int* length);
+
+private:
+    static const Uint8 k_H264TestFrame[];
+    static const Uint8 k_HEVCMainTestFrame[];
+    static const Uint8 k_HEVCMain10TestFrame[];
+};
@@ -0,0 +1,191 @@
+#include "videostats.h"
+
+#include <stdio.h>
+
+void VideoStats::add(VIDEO_STATS& src, VIDEO_STATS& dst)
+{
+    dst.receivedFrames += src.receivedFrames;
+    dst.decodedFrames += src.decodedFrames;
+    dst.renderedFrames += src.renderedFrames;
+    dst.totalFrames += src.totalFrames;
+    dst.networkDroppedFrames += src.networkDroppedFrames;
+    dst.pacerDroppedFrames += src.pacerDroppedFrames;
+    dst.reassemblyTime.add(src.reassemblyTime);
+    dst.decodeTime.add(src.decodeTime);
+    dst.pacerTime.add(src.pacerTime);
+    dst.renderTime.add(src.renderTime);
+    dst.decodedFrameInterval.add(src.decodedFrameInterval);
+    dst.renderedFrameInterval.add(src.renderedFrameInterval);
+    dst.packetBufferAllocations += src.packetBufferAllocations;
+    dst.totalCopiedBytes += src.totalCopiedBytes;
+    dst.decodeQueueDroppedFrames += src.decodeQueueDroppedFrames;
+    dst.decoderDroppedFrames += src.decoderDroppedFrames;
+    dst.totalDecodeQueueDepth += src.totalDecodeQueueDepth;
+    for (int i = 0; i < DECODER_RECOVERY_TIERS; i++) {
+        dst.decoderRecoveries[i] += src.decoderRecoveries[i];
+        dst.totalDecoderRecoveryTime[i] += src.totalDecoderRecoveryTime[i];
+    }
+    dst.pacerHeldFrames += src.pacerHeldFrames;
+    dst.cadenceSkippedFrames += src.cadenceSkippedFrames;
+
+    // Clock drift is an estimate rather than a count, so keep the latest one
+    if (src.clockDriftKnown) {
+        dst.clockDriftKnown = true;
+        dst.clockDriftPpm = src.clockDriftPpm;
+    }
+
+    Uint32 now = SDL_GetTicks();
+
+    // Initialize the measurement start point if this is the first video stat window
+    if (!dst.measurementStartTimestamp) {
+        dst.measurementStartTimestamp = src.measurementStartTimestamp;
+    }
+
+    // The following code assumes the global measure was already started first
+    SDL_assert(dst.measurementStartTimestamp <= src.measurementStartTimestamp);
+
+    dst.totalFps = (float)dst.totalFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.receivedFps = (float)dst.receivedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.decodedFps = (float)dst.decodedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.renderedFps = (float)dst.renderedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+}
+
+void VideoStats::stringify(VIDEO_STATS& stats, int videoFormat, int width, int height, char* output)
+{
+    int offset = 0;
+    const char* codecString;
+
+    // Start with an empty string
+    output[offset] = 0;
+
+    switch (videoFormat)
+    {
+    case VIDEO_FORMAT_H264:
+        codecString = "H.264";
+        break;
+
+    case VIDEO_FORMAT_H265:
+        codecString = "HEVC";
+        break;
+
+    case VIDEO_FORMAT_H265_MAIN10:
+        codecString = "HEVC Main 10";
+        break;
+
+    default:
+        SDL_assert(false);
+        codecString = "UNKNOWN";
+        break;
+    }
+
+    if (stats.receivedFps > 0) {
+        if (width != 0 && height != 0) {
+            offset += sprintf(&output[offset],
+                              "Video stream: %dx%d %.2f FPS (Codec: %s)\n",
+                              width,
+                              height,
+                              stats.totalFps,
+                              codecString);
+        }
+
+        offset += sprintf(&output[offset],
+                          "Incoming frame rate from network: %.2f FPS\n"
+                          "Decoding frame rate: %.2f FPS\n"
+                          "Rendering frame rate: %.2f FPS\n",
+                          stats.receivedFps,
+                          stats.decodedFps,
+                          stats.renderedFps);
+    }
+
+    if (stats.renderedFrames != 0) {
+        offset += sprintf(&output[offset],
+                          "Frames dropped by your network connection: %.2f%%\n"
+                          "Frames dropped due to network jitter: %.2f%%\n"
+                          "Latency (ms): avg / p50 / p95 / p99 / max\n",
+                          (float)stats.networkDroppedFrames / stats.totalFrames * 100,
+                          (float)stats.pacerDroppedFrames / stats.decodedFrames * 100);
+
+        offset += stringifyLatency(stats.reassemblyTime, "Receive", &output[offset]);
+        offset += stringifyLatency(stats.decodeTime, "Decoding", &output[offset]);
+        offset += stringifyLatency(stats.pacerTime, "Frame queue", &output[offset]);
+        offset += stringifyLatency(stats.renderTime, "Rendering (incl. V-sync)", &output[offset]);
+
+        // How evenly frames come out of the decoder and go to the display
+        offset += sprintf(&output[offset],
+                          "Frame time std dev (ms): %.2f decoded / %.2f rendered\n",
+                          stats.decodedFrameInterval.getStdDevMs(),
+                          stats.renderedFrameInterval.getStdDevMs());
+    }
+
+    if (stats.decoderDroppedFrames != 0) {
+        offset += sprintf(&output[offset],
+                          "Frames dropped by the decoder: %.2f%%\n",
+                          (float)stats.decoderDroppedFrames / stats.totalFrames * 100);
+    }
+
+    if (stats.cadenceSkippedFrames != 0) {
+        offset += sprintf(&output[offset],
+                          "Frames skipped for display cadence: %.2f%%\n",
+                          (float)stats.cadenceSkippedFrames / stats.decodedFrames * 100);
+    }
+
+    if (stats.receivedFrames != 0) {
+        offset += sprintf(&output[offset],
+                          "Packet buffers allocated: %u (%.2f KB copied per frame)\n",
+                          stats.packetBufferAllocations,
+                          (float)stats.totalCopiedBytes / stats.receivedFrames / 1024);
+    }
+
+    for (int i = 0; i < DECODER_RECOVERY_TIERS; i++) {
+        static const char* k_RecoveryTierNames[DECODER_RECOVERY_TIERS] = { "Flush", "Recreate", "Reset" };
+
+        if (stats.decoderRecoveries[i] != 0) {
+            offset += sprintf(&output[offset],
+                              "Decoder recoveries (%s): %u (average %.2f ms)\n",
+                              k_RecoveryTierNames[i],
+                              stats.decoderRecoveries[i],
+                              (float)stats.totalDecoderRecoveryTime[i] / stats.decoderRecoveries[i]);
+        }
+    }
+
+    if (stats.clockDriftKnown) {
+        offset += sprintf(&output[offset],
+                          "Host clock drift: %+d ppm (frames held for pacing: %u)\n",
+                          stats.clockDriftPpm,
+                          stats.pacerHeldFrames);
+    }
+
+    // Queue depth is only tracked when we have a decoder thread
+    if (stats.totalDecodeQueueDepth != 0) {
+        offset += sprintf(&output[offset],
+                          "Frames dropped by decoder thread: %.2f%% (average queue depth: %.2f)\n",
+                          (float)stats.decodeQueueDroppedFrames / stats.totalFrames * 100,
+                          (float)stats.totalDecodeQueueDepth / (stats.receivedFrames - stats.decodeQueueDroppedFrames));
+    }
+}
+
+int VideoStats::stringifyLatency(LatencyHistogram& histogram, const char* stage, char* output)
+{
+    return sprintf(output,
+                   "  %s: %.2f / %.2f / %.2f / %.2f / %.2f\n",
+                   stage,
+                   histogram.getAverageMs(),
+                   histogram.getPercentileMs(50),
+                   histogram.getPercentileMs(95),
+                   histogram.getPercentileMs(99),
+                   histogram.getMaxMs());
+}
+
+void VideoStats::log(VIDEO_STATS& stats, int videoFormat, int width, int height, const char* title)
+{
+    if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
+        char videoStatsStr[2048];
+        stringify(stats, videoFormat, width, height, videoStatsStr);
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "%s", title);
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "----------------------------------------------------------\n%s",
+                    videoStatsStr);
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "decoder.h"
+
+// Rolls up and formats the VIDEO_STATS windows that decoders collect,
+// so every decoder reports through the same overlay and log output.
+class VideoStats
+{
+public:
+    static void add(VIDEO_STATS& src, VIDEO_STATS& dst);
+
+    // The video size is left out if it's unknown (zero)
+    static void stringify(VIDEO_STATS& stats, int videoFormat, int width, int height, char* output);
+
+    static void log(VIDEO_STATS& stats, int videoFormat, int width, int height, const char* title);
+
+private:
+    static int stringifyLatency(LatencyHistogram& histogram, const char* stage, char* output);
+};
@@ -0,0 +1,163 @@
+#include "videostatsshard.h"
+
+VideoStatsShard::VideoStatsShard()
+{
+    m_Sequence.store(0, std::memory_order_relaxed);
+
+    for (int i = 0; i < VSC_MAX; i++) {
+        m_Counters[i].store(0, std::memory_order_relaxed);
+    }
+
+    for (int i = 0; i < VSS_MAX; i++) {
+        for (int j = 0; j < LATENCY_HISTOGRAM_BUCKETS; j++) {
+            m_Histograms[i].buckets[j].store(0, std::memory_order_relaxed);
+        }
+
+        m_Histograms[i].count.store(0, std::memory_order_relaxed);
+        m_Histograms[i].totalUs.store(0, std::memory_order_relaxed);
+        m_Histograms[i].windowMaxUs.store(0, std::memory_order_relaxed);
+    }
+
+    SDL_zero(m_Current);
+    SDL_zero(m_Last);
+}
+
+void VideoStatsShard::increment(std::atomic<Uint32>& value, Uint32 amount)
+{
+    // We're the only writer, so this doesn't need to be an atomic add
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void VideoStatsShard::beginUpdate()
+{
+    // An odd sequence number tells the reader that an update is in progress
+    m_Sequence.store(m_Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void VideoStatsShard::endUpdate()
+{
+    m_Sequence.store(m_Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void VideoStatsShard::add(VideoStatsCounter counter, Uint32 value)
+{
+    SDL_assert(m_Sequence.load(std::memory_order_relaxed) & 1);
+
+    increment(m_Counters[counter], value);
+}
+
+void VideoStatsShard::record(VideoStatsStage stage, Uint64 valueUs)
+{
+    SDL_assert(m_Sequence.load(std::memory_order_relaxed) & 1);
+
+    Histogram& histogram = m_Histograms[stage];
+    Uint32 clampedValueUs = (Uint32)SDL_min(valueUs, (Uint64)0xFFFFFFFF);
+
+    increment(histogram.buckets[LatencyHistogram::getBucketIndex(valueUs)], 1);
+    increment(histogram.count, 1);
+    increment(histogram.totalUs, clampedValueUs);
+
+    // The reader clears the max for each window, so this must not lose a race with it
+    Uint32 maxUs = histogram.windowMaxUs.load(std::memory_order_relaxed);
+    while (clampedValueUs > maxUs &&
+           !histogram.windowMaxUs.compare_exchange_weak(maxUs, clampedValueUs, std::memory_order_relaxed));
+}
+
+void VideoStatsShard::takeSnapshot(Snapshot& snapshot)
+{
+    for (;;) {
+        Uint32 sequence = m_Sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            // The writer is in the middle of an update
+            continue;
+        }
+
+        for (int i = 0; i < VSC_MAX; i++) {
+            snapshot.counters[i] = m_Counters[i].load(std::memory_order_relaxed);
+        }
+
+        for (int i = 0; i < VSS_MAX; i++) {
+            for (int j = 0; j < LATENCY_HISTOGRAM_BUCKETS; j++) {
+                snapshot.buckets[i][j] = m_Histograms[i].buckets[j].load(std::memory_order_relaxed);
+            }
+
+            snapshot.counts[i] = m_Histograms[i].count.load(std::memory_order_relaxed);
+            snapshot.totalsUs[i] = m_Histograms[i].totalUs.load(std::memory_order_relaxed);
+        }
+
+        // Make sure our reads are done before checking for a concurrent update
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_Sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+}
+
+LatencyHistogram& VideoStatsShard::getWindowHistogram(VIDEO_STATS& window, VideoStatsStage stage)
+{
+    switch (stage) {
+    case VSS_REASSEMBLY:
+        return window.reassemblyTime;
+    case VSS_DECODE:
+        return window.decodeTime;
+    case VSS_PACER:
+        return window.pacerTime;
+    case VSS_RENDER:
+        return window.renderTime;
+    case VSS_DECODED_FRAME_INTERVAL:
+        return window.decodedFrameInterval;
+    default:
+        SDL_assert(stage == VSS_RENDERED_FRAME_INTERVAL);
+        return window.renderedFrameInterval;
+    }
+}
+
+void VideoStatsShard::collect(VIDEO_STATS& window)
+{
+    takeSnapshot(m_Current);
+
+    // Unsigned subtraction takes care of wrapped values
+    Uint32 deltas[VSC_MAX];
+    for (int i = 0; i < VSC_MAX; i++) {
+        deltas[i] = m_Current.counters[i] - m_Last.counters[i];
+    }
+
+    window.receivedFrames += deltas[VSC_RECEIVED_FRAMES];
+    window.decodedFrames += deltas[VSC_DECODED_FRAMES];
+    window.renderedFrames += deltas[VSC_RENDERED_FRAMES];
+    window.totalFrames += deltas[VSC_TOTAL_FRAMES];
+    window.networkDroppedFrames += deltas[VSC_NETWORK_DROPPED_FRAMES];
+    window.pacerDroppedFrames += deltas[VSC_PACER_DROPPED_FRAMES];
+    window.packetBufferAllocations += deltas[VSC_PACKET_BUFFER_ALLOCATIONS];
+    window.totalCopiedBytes += deltas[VSC_COPIED_BYTES];
+    window.decodeQueueDroppedFrames += deltas[VSC_DECODE_QUEUE_DROPPED_FRAMES];
+    window.totalDecodeQueueDepth += deltas[VSC_DECODE_QUEUE_DEPTH];
+    window.decoderRecoveries[DECODER_RECOVERY_FLUSH] += deltas[VSC_FLUSH_RECOVERIES];
+    window.totalDecoderRecoveryTime[DECODER_RECOVERY_FLUSH] += deltas[VSC_FLUSH_RECOVERY_TIME];
+    window.decoderRecoveries[DECODER_RECOVERY_RECREATE] += deltas[VSC_RECREATE_RECOVERIES];
+    window.totalDecoderRecoveryTime[DECODER_RECOVERY_RECREATE] += deltas[VSC_RECREATE_RECOVERY_TIME];
+    window.decoderRecoveries[DECODER_RECOVERY_RESET] += deltas[VSC_RESET_RECOVERIES];
+    window.totalDecoderRecoveryTime[DECODER_RECOVERY_RESET] += deltas[VSC_RESET_RECOVERY_TIME];
+    window.pacerHeldFrames += deltas[VSC_PACER_HELD_FRAMES];
+    window.cadenceSkippedFrames += deltas[VSC_CADENCE_SKIPPED_FRAMES];
+    window.decoderDroppedFrames += deltas[VSC_DECODER_DROPPED_FRAMES];
+
+    for (int i = 0; i < VSS_MAX; i++) {
+        LatencyHistogram& histogram = getWindowHistogram(window, (VideoStatsStage)i);
+
+        for (int j = 0; j < LATENCY_HISTOGRAM_BUCKETS; j++) {
+            histogram.m_Buckets[j] += m_Current.buckets[i][j] - m_Last.buckets[i][j];
+        }
+
+        histogram.m_Count += m_Current.counts[i] - m_Last.counts[i];
+        histogram.m_TotalUs += m_Current.totalsUs[i] - m_Last.totalsUs[i];
+
+        // A sample recorded after our snapshot may land in this max rather
+        // than the next one, but it is never lost.
+        Uint64 windowMaxUs = m_Histograms[i].windowMaxUs.exchange(0, std::memory_order_relaxed);
+        histogram.m_MaxUs = SDL_max(histogram.m_MaxUs, windowMaxUs);
+    }
+
+    SDL_memcpy(&m_Last, &m_Current, sizeof(m_Last));
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+
+#include "decoder.h"
+
+enum VideoStatsCounter {
+    VSC_RECEIVED_FRAMES,
+    VSC_DECODED_FRAMES,
+    VSC_RENDERED_FRAMES,
+    VSC_TOTAL_FRAMES,
+    VSC_NETWORK_DROPPED_FRAMES,
+    VSC_PACER_DROPPED_FRAMES,
+    VSC_PACKET_BUFFER_ALLOCATIONS,
+    VSC_COPIED_BYTES,
+    VSC_DECODE_QUEUE_DROPPED_FRAMES,
+    VSC_DECODE_QUEUE_DEPTH,
+    VSC_FLUSH_RECOVERIES,
+    VSC_FLUSH_RECOVERY_TIME,
+    VSC_RECREATE_RECOVERIES,
+    VSC_RECREATE_RECOVERY_TIME,
+    VSC_RESET_RECOVERIES,
+    VSC_RESET_RECOVERY_TIME,
+    VSC_PACER_HELD_FRAMES,
+    VSC_CADENCE_SKIPPED_FRAMES,
+    VSC_DECODER_DROPPED_FRAMES,
+    VSC_MAX
+};
+
+enum VideoStatsStage {
+    VSS_REASSEMBLY,
+    VSS_DECODE,
+    VSS_PACER,
+    VSS_RENDER,
+    VSS_DECODED_FRAME_INTERVAL,
+    VSS_RENDERED_FRAME_INTERVAL,
+    VSS_MAX
+};
+
+// Video statistics recorded by a single thread. The owning thread publishes
+// updates with relaxed atomics inside a sequence lock, so it never blocks.
+// The stats thread rolls the shard up into a VIDEO_STATS window from a
+// consistent snapshot, retrying if it raced with an update.
+//
+// Values only ever grow (wrapping at 32 bits), so the reader computes each
+// window from the difference between snapshots instead of clearing them.
+class VideoStatsShard
+{
+public:
+    VideoStatsShard();
+
+    // Only the owning thread may call these. Updates made between
+    // beginUpdate() and endUpdate() are published together.
+    void beginUpdate();
+
+    void add(VideoStatsCounter counter, Uint32 value);
+
+    void record(VideoStatsStage stage, Uint64 valueUs);
+
+    void endUpdate();
+
+    // Only the stats thread may call this. Adds everything recorded since
+    // the previous call to the counters and histograms in window.
+    void collect(VIDEO_STATS& window);
+
+private:
+    struct Histogram {
+        std::atomic<Uint32> buckets[LATENCY_HISTOGRAM_BUCKETS];
+        std::atomic<Uint32> count;
+        std::atomic<Uint32> totalUs;
+
+        // Reset by the reader at each collection
+        std::atomic<Uint32> windowMaxUs;
+    };
+
+    struct Snapshot {
+        Uint32 counters[VSC_MAX];
+        Uint32 buckets[VSS_MAX][LATENCY_HISTOGRAM_BUCKETS];
+        Uint32 counts[VSS_MAX];
+        Uint32 totalsUs[VSS_MAX];
+    };
+
+    void takeSnapshot(Snapshot& snapshot);
+
+    static void increment(std::atomic<Uint32>& value, Uint32 amount);
+
+    static LatencyHistogram& getWindowHistogram(VIDEO_STATS& window, VideoStatsStage stage);
+
+    // Written by the owning thread
+    std::atomic<Uint32> m_Sequence;
+    std::atomic<Uint32> m_Counters[VSC_MAX];
+    Histogram m_Histograms[VSS_MAX];
+
+    // Private to the stats thread
+    Snapshot m_Current;
+    Snapshot m_Last;
+};
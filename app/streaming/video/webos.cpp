@@ -1,66 +1,243 @@
 #include "webos.h"
+#include "videostats.h"
+#include "decodeunitsize.h"
+#include "videosamples.h"
 #include "streaming/streamutils.h"
+#include "streaming/session.h"
 
 #include <QDebug>
 
 extern "C" {
 #include <gst/app/gstappsrc.h>
-#include "webos/lxvideo.h"
+#include <gst/app/gstappsink.h>
 }
 #include <fstream>
 #define MAX_SPS_EXTRA_SIZE 16
 
+// All of the input pool's buffers are allocated up front, so any later allocation
+// means the pipeline was holding on to all of them or a frame didn't fit.
+#define INPUT_POOL_BUFFERS 8
+
+// Each buffer we push is one complete access unit in Annex B format, so the
+// parser can pass them straight through instead of searching for frame
+// boundaries and holding a frame back until it sees the next one.
+#define H264_INPUT_CAPS "video/x-h264,stream-format=byte-stream,alignment=au"
+#define HEVC_INPUT_CAPS "video/x-h265,stream-format=byte-stream,alignment=au"
+
+// How long to wait for the decoder to output the test frame
+#define TEST_FRAME_TIMEOUT_MS 3000
+
 WebOSVideoDecoder::WebOSVideoDecoder(bool testOnly)
-    : m_Renderer(nullptr),
+    : m_Source(nullptr),
+      m_Sink(nullptr),
       m_Pipeline(nullptr),
+      m_Bus(nullptr),
+      m_Renderer(nullptr),
+      m_Overlay(new SdlOverlay()),
+      m_InputPool(nullptr),
+      m_InputBufferSize(0),
+      m_InputBufferAllocations(0),
+      m_LastOutputTimeUs(0),
+      m_HaveOutputHdrInfo(false),
+      m_OutputHdrType(LXDEBUFEXT_HDR_TYPE_UNDEFINED),
+      m_OutputCaps(nullptr),
+      m_OutputColorLock(0),
+      m_ActiveWndStartTime(0),
+      m_LastFrameNumber(0),
+      m_VideoFormat(0),
+      m_VideoWidth(0),
+      m_VideoHeight(0),
       m_NeedsSpsFixup(false),
       m_TestOnly(testOnly)
 {
     qDebug() << "webOS Video decoder";
+
+    SDL_AtomicSet(&m_ResetStartTime, 0);
+    SDL_AtomicSet(&m_RedrawPending, 0);
+    SDL_AtomicSet(&m_VideoStarted, 0);
+    SDL_zero(m_LastWndVideoStats);
+    SDL_zero(m_GlobalVideoStats);
+    SDL_zero(m_OutputHdrHeader);
+    SDL_zero(m_OutputHdrSei);
+    SDL_zero(m_OutputColorDescription);
 }
 
 WebOSVideoDecoder::~WebOSVideoDecoder()
 {
+    // There's no session when replaying captured decode units
+    if (!m_TestOnly && Session::get() != nullptr) {
+        Session::get()->getOverlayManager().setOverlayRenderer(nullptr);
+    }
+
+    // Stopping the pipeline joins its streaming threads,
+    // so nobody is recording output stats after this.
+    if (m_Pipeline != nullptr) {
+        gst_element_set_state(m_Pipeline, GST_STATE_NULL);
+    }
+    if (m_Source != nullptr) {
+        gst_object_unref(m_Source);
+    }
+    if (m_Sink != nullptr) {
+        gst_object_unref(m_Sink);
+    }
+    if (m_Bus != nullptr) {
+        gst_object_unref(m_Bus);
+    }
+    if (m_OutputCaps != nullptr) {
+        gst_caps_unref(m_OutputCaps);
+    }
     if (m_Pipeline != nullptr) {
-        gst_object_unref (m_Pipeline);
+        gst_object_unref(m_Pipeline);
+    }
+    if (m_InputPool != nullptr) {
+        // Buffers still held by the pipeline are freed when it drops them
+        gst_buffer_pool_set_active(m_InputPool, FALSE);
+        gst_object_unref(m_InputPool);
+    }
+    if (!m_TestOnly) {
+        VIDEO_STATS globalStats;
+        getFinalVideoStats(globalStats);
+        VideoStats::log(globalStats, m_VideoFormat,
+                        m_VideoWidth, m_VideoHeight,
+                        "Global video stats");
     }
+
+    // The overlay textures belong to m_Renderer
+    delete m_Overlay;
+
     if (m_Renderer != nullptr) {
         SDL_DestroyRenderer(m_Renderer);
     }
 }
 
+QByteArray WebOSVideoDecoder::getElementDescription(const char* envVar, const char* defaultDescription)
+{
+    // This can be a whole element description with properties,
+    // such as "avdec_h264 max-threads=1" for a desktop without lxvideodec
+    QByteArray description = qgetenv(envVar);
+    if (description.isEmpty()) {
+        return defaultDescription;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using %s from %s",
+                description.constData(),
+                envVar);
+    return description;
+}
+
+QByteArray WebOSVideoDecoder::buildPipelineDescription(PDECODER_PARAMETERS params, QByteArray& decoderName)
+{
+    QByteArray parser, decoder;
+
+    if (params->videoFormat & VIDEO_FORMAT_MASK_H264) {
+        parser = getElementDescription("WEBOS_H264_PARSER", "h264parse");
+        decoder = getElementDescription("WEBOS_H264_DECODER", "lxvideodec");
+    }
+    else if (params->videoFormat & VIDEO_FORMAT_MASK_H265) {
+        parser = getElementDescription("WEBOS_HEVC_PARSER", "h265parse");
+        decoder = getElementDescription("WEBOS_HEVC_DECODER", "lxvideodec");
+    }
+    else {
+        SDL_assert(false);
+        return QByteArray();
+    }
+
+    // The element name without any properties, for the metrics exporter
+    decoderName = decoder.split(' ').first();
+
+    // The appsink hands us every decoded frame as soon as it's ready, rather
+    // than syncing to the pipeline clock or letting frames back up behind us.
+    return "appsrc name=src ! " + parser + " ! " + decoder +
+            " ! appsink name=sink emit-signals=true sync=false max-buffers=1 drop=true";
+}
+
 bool WebOSVideoDecoder::initialize(PDECODER_PARAMETERS params) 
 {
     qDebug() << "WebOSVideoDecoder::initialize";
 
+    m_VideoFormat = params->videoFormat;
+    m_VideoWidth = params->width;
+    m_VideoHeight = params->height;
+
+    // The decoder will happily accept any HEVC caps without telling us
+    // which profiles it can actually decode, so make it decode a frame.
+    // The session always probes in test-only mode before streaming, so
+    // the real decoder and its resets don't need to do this again.
+    if (m_TestOnly && params->videoFormat == VIDEO_FORMAT_H265_MAIN10 && !decodeTestFrame(params)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decoder doesn't support HEVC Main10");
+        return false;
+    }
+
     GstElement *pipeline, *source, *sink;
+    GError *error = NULL;
     /* Create the elements */
-    // pipeline = gst_parse_launch("appsrc name=src ! h264parse ! lxvideodec ! lxvideosink name=sink", NULL);
-    pipeline = gst_parse_launch("appsrc name=src ! h264parse ! lxvideodec ! appsink name=sink emit-signals=true", NULL);
+    QByteArray pipelineDescription = buildPipelineDescription(params, m_DecoderName);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "GStreamer pipeline: %s",
+                pipelineDescription.constData());
+    pipeline = gst_parse_launch(pipelineDescription.constData(), &error);
+    if (!pipeline) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "gst_parse_launch() failed: %s",
+                     error != NULL ? error->message : "unknown error");
+        g_clear_error(&error);
+        return false;
+    }
+    else if (error != NULL) {
+        // Recoverable problems, like a property the element doesn't have
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "gst_parse_launch() warning: %s",
+                    error->message);
+        g_clear_error(&error);
+    }
+
+    m_Pipeline = pipeline;
+    m_Bus = gst_element_get_bus(pipeline);
     source = gst_bin_get_by_name(GST_BIN(pipeline), "src");
     sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    m_Source = source;
+    m_Sink = sink;
 
-    if (!pipeline || !source || !sink) {
+    if (!source || !sink) {
         g_printerr ("Not all elements could be created.\n");
         return false;
     }
 
+    {
+        // We're a live source that pushes each frame as soon as it arrives
+        GstCaps* caps = gst_caps_from_string((params->videoFormat & VIDEO_FORMAT_MASK_H264) ?
+                                                 H264_INPUT_CAPS : HEVC_INPUT_CAPS);
+        gst_app_src_set_caps(GST_APP_SRC(source), caps);
+        gst_caps_unref(caps);
+
+        g_object_set(source,
+                     "is-live", TRUE,
+                     "format", GST_FORMAT_TIME,
+                     "do-timestamp", TRUE,
+                     // Never block the receive thread
+                     "block", FALSE,
+                     "min-latency", (gint64)0,
+                     NULL);
+    }
+
     if (strcmp("GstAppSink", g_type_name(G_OBJECT_TYPE(sink))) == 0) {
         g_signal_connect(sink, "new-preroll", G_CALLBACK(gstSinkNewPreroll), this);
         g_signal_connect(sink, "new-sample", G_CALLBACK(gstSinkNewSample), this);
     }
 
-    m_Source = source;
-    m_Sink = sink;
-    m_Pipeline = pipeline;
-
-    Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+    {
+        int bufferSize = getDecodeUnitBufferSize(params->width, params->height,
+                                                 params->frameRate, params->bitrate);
 
-    if (params->videoFormat == VIDEO_FORMAT_H265_MAIN10) {
-        // SDL doesn't support rendering YUV 10-bit textures yet
-        return false;
+        if (!resizeInputPool(bufferSize)) {
+            return false;
+        }
     }
 
+    Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+
     if ((SDL_GetWindowFlags(params->window) & SDL_WINDOW_FULLSCREEN_DESKTOP) == SDL_WINDOW_FULLSCREEN) {
         // In full-screen exclusive mode, we enable V-sync if requested. For other modes, Windows and Mac
         // have compositors that make rendering tear-free. Linux compositor varies by distro and user
@@ -111,6 +288,18 @@ bool WebOSVideoDecoder::initialize(PDECODER_PARAMETERS params)
     SDL_SetRenderDrawColor(m_Renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
     SDL_RenderClear(m_Renderer);
     SDL_RenderPresent(m_Renderer);
+
+    if (!m_TestOnly && gst_element_set_state(m_Pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to start GStreamer pipeline");
+        return false;
+    }
+
+    // Tell overlay manager to draw overlays on our SDL layer
+    if (!m_TestOnly && Session::get() != nullptr) {
+        Session::get()->getOverlayManager().setOverlayRenderer(this);
+    }
+
     return true;
 }
 
@@ -142,7 +331,10 @@ int WebOSVideoDecoder::getDecoderCapabilities()
 
 int WebOSVideoDecoder::getDecoderColorspace() 
 {
-    return COLORSPACE_REC_601;
+    // The decoder reads the colorspace from the VUI and the TV converts
+    // the video plane itself, so we can ask for the HD colorspace. HDR
+    // streams are always BT.2020 regardless of what we ask for here.
+    return COLORSPACE_REC_709;
 }
 
 QSize WebOSVideoDecoder::getDecoderMaxResolution() 
@@ -150,12 +342,440 @@ QSize WebOSVideoDecoder::getDecoderMaxResolution()
     return QSize(3840, 2160);
 }
 
+bool WebOSVideoDecoder::resizeInputPool(int bufferSize)
+{
+    if (m_InputPool != nullptr) {
+        // Outstanding buffers from the old pool are freed once
+        // the pipeline drops its references to them
+        gst_buffer_pool_set_active(m_InputPool, FALSE);
+        gst_object_unref(m_InputPool);
+        m_InputPool = nullptr;
+    }
+
+    GstBufferPool* pool = gst_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, nullptr, bufferSize,
+                                      INPUT_POOL_BUFFERS, INPUT_POOL_BUFFERS);
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to create input buffer pool");
+        gst_object_unref(pool);
+        return false;
+    }
+
+    m_InputPool = pool;
+    m_InputBufferSize = bufferSize;
+
+    // Going over this only makes appsrc emit enough-data, since it
+    // doesn't block. More than the pool's worth means the decoder
+    // has fallen behind.
+    g_object_set(m_Source,
+                 "max-bytes", (guint64)INPUT_POOL_BUFFERS * m_InputBufferSize,
+                 NULL);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Input buffer pool: %d buffers of %d KB",
+                INPUT_POOL_BUFFERS,
+                m_InputBufferSize / 1024);
+    return true;
+}
+
+GstBuffer* WebOSVideoDecoder::getInputBuffer(int size)
+{
+    GstBuffer* buf = nullptr;
+
+    if (size > m_InputBufferSize) {
+        // Grow with some headroom so a run of large frames doesn't
+        // cause us to recreate the pool for each of them.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Growing input buffer pool for %d byte frame",
+                    size);
+        resizeInputPool(size + size / 2);
+    }
+
+    if (m_InputPool != nullptr && size <= m_InputBufferSize) {
+        // Waiting for the pipeline to release a buffer would stall the receive thread
+        GstBufferPoolAcquireParams acquireParams = {};
+        acquireParams.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+        if (gst_buffer_pool_acquire_buffer(m_InputPool, &buf, &acquireParams) != GST_FLOW_OK) {
+            buf = nullptr;
+        }
+    }
+
+    if (buf == nullptr) {
+        buf = gst_buffer_new_allocate(NULL, size, NULL);
+        m_InputBufferAllocations++;
+    }
+
+    return buf;
+}
+
+bool WebOSVideoDecoder::getRunningTime(GstElement* element, GstClockTime* runningTime)
+{
+    GstClock* clock = gst_element_get_clock(element);
+    if (clock == nullptr) {
+        // Not playing yet
+        return false;
+    }
+
+    GstClockTime now = gst_clock_get_time(clock);
+    GstClockTime baseTime = gst_element_get_base_time(element);
+    gst_object_unref(clock);
+
+    if (now < baseTime) {
+        return false;
+    }
+
+    *runningTime = now - baseTime;
+    return true;
+}
+
+bool WebOSVideoDecoder::decodeTestFrame(PDECODER_PARAMETERS params)
+{
+    int length;
+    const Uint8* data = VideoSamples::getTestFrame(params->videoFormat, &length);
+    if (data == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No test frame for format: %x",
+                     params->videoFormat);
+        return false;
+    }
+
+    // A throwaway copy of the real pipeline, torn down before
+    // we create the real one so they never share the decoder.
+    QByteArray decoderName;
+    QByteArray pipelineDescription = buildPipelineDescription(params, decoderName);
+    GError* error = NULL;
+    GstElement* pipeline = gst_parse_launch(pipelineDescription.constData(), &error);
+    g_clear_error(&error);
+    if (pipeline == nullptr) {
+        return false;
+    }
+
+    GstElement* source = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    bool decoded = false;
+
+    if (source != nullptr && sink != nullptr &&
+            strcmp("GstAppSink", g_type_name(G_OBJECT_TYPE(sink))) == 0 &&
+            gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+        GstCaps* caps = gst_caps_from_string(HEVC_INPUT_CAPS);
+        gst_app_src_set_caps(GST_APP_SRC(source), caps);
+        gst_caps_unref(caps);
+
+        GstBuffer* buf = gst_buffer_new_allocate(NULL, length, NULL);
+        gst_buffer_fill(buf, 0, data, length);
+        gst_app_src_push_buffer(GST_APP_SRC(source), buf);
+
+        // EOS makes the parser and decoder drain rather than
+        // holding the frame back waiting for the next one.
+        gst_app_src_end_of_stream(GST_APP_SRC(source));
+
+        GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink),
+                                                         TEST_FRAME_TIMEOUT_MS * GST_MSECOND);
+        if (sample != nullptr) {
+            decoded = true;
+            gst_sample_unref(sample);
+        }
+        else {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "%s didn't output the test frame",
+                        decoderName.constData());
+        }
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (source != nullptr) {
+        gst_object_unref(source);
+    }
+    if (sink != nullptr) {
+        gst_object_unref(sink);
+    }
+    gst_object_unref(pipeline);
+
+    return decoded;
+}
+
+const char* WebOSVideoDecoder::getHdrTypeName(lxdebufext_hdr_type hdrType)
+{
+    switch (hdrType) {
+    case LXDEBUFEXT_HDR_TYPE_SDR:
+        return "SDR";
+    case LXDEBUFEXT_HDR_TYPE_HDR10:
+        return "HDR10";
+    case LXDEBUFEXT_HDR_TYPE_HLG:
+        return "HLG";
+    case LXDEBUFEXT_HDR_TYPE_PRIME:
+        return "Technicolor HDR";
+    case LXDEBUFEXT_HDR_TYPE_DOLBY:
+        return "Dolby Vision";
+    default:
+        return "Unknown";
+    }
+}
+
+void WebOSVideoDecoder::updateOutputColor(const LXDEBuffer& lxbuf)
+{
+    if (m_HaveOutputHdrInfo &&
+            lxbuf.hdr_type == m_OutputHdrType &&
+            SDL_memcmp(&lxbuf.hdr_header, &m_OutputHdrHeader, sizeof(m_OutputHdrHeader)) == 0 &&
+            SDL_memcmp(&lxbuf.hdr_sei, &m_OutputHdrSei, sizeof(m_OutputHdrSei)) == 0) {
+        return;
+    }
+
+    m_HaveOutputHdrInfo = true;
+    m_OutputHdrType = lxbuf.hdr_type;
+    m_OutputHdrHeader = lxbuf.hdr_header;
+    m_OutputHdrSei = lxbuf.hdr_sei;
+
+    // The VUI codes are the ones from H.273, so 9/16/9 is BT.2020 PQ
+    char description[sizeof(m_OutputColorDescription)];
+    int offset = SDL_snprintf(description, sizeof(description),
+                              "%s: primaries %u, transfer %u, matrix %u, %s range",
+                              getHdrTypeName(lxbuf.hdr_type),
+                              lxbuf.hdr_header.color_primaries,
+                              lxbuf.hdr_header.transfer_characteristics,
+                              lxbuf.hdr_header.matrix_coeffs,
+                              lxbuf.hdr_header.video_full_range_flag ? "full" : "limited");
+
+    if (lxbuf.hdr_type == LXDEBUFEXT_HDR_TYPE_HDR10 && offset > 0 && offset < (int)sizeof(description)) {
+        // Mastering luminance is in units of 0.0001 nits, as in the SEI
+        SDL_snprintf(&description[offset], sizeof(description) - offset,
+                     "\nMastering display: %.4f-%.0f nits, MaxCLL %u, MaxFALL %u",
+                     lxbuf.hdr_sei.min_disp_mastering_luminance / 10000.0,
+                     lxbuf.hdr_sei.max_disp_mastering_luminance / 10000.0,
+                     lxbuf.hdr_sei.max_content_light_level,
+                     lxbuf.hdr_sei.max_pic_average_light_level);
+    }
+
+    setOutputColorDescription(description);
+}
+
+void WebOSVideoDecoder::updateOutputColor(GstCaps* caps)
+{
+    // appsink hands out the same caps until they change
+    if (caps == nullptr || caps == m_OutputCaps) {
+        return;
+    }
+
+    gst_caps_replace(&m_OutputCaps, caps);
+
+    GstStructure* structure = gst_caps_get_structure(caps, 0);
+    const gchar* format = gst_structure_get_string(structure, "format");
+    const gchar* colorimetry = gst_structure_get_string(structure, "colorimetry");
+    const gchar* masteringDisplay = gst_structure_get_string(structure, "mastering-display-info");
+    const gchar* contentLightLevel = gst_structure_get_string(structure, "content-light-level");
+
+    char description[sizeof(m_OutputColorDescription)];
+    int offset = SDL_snprintf(description, sizeof(description),
+                              "%s: colorimetry %s",
+                              format != nullptr ? format : "Unknown",
+                              colorimetry != nullptr ? colorimetry : "unknown");
+
+    if (masteringDisplay != nullptr && offset > 0 && offset < (int)sizeof(description)) {
+        SDL_snprintf(&description[offset], sizeof(description) - offset,
+                     "\nMastering display: %s, light level %s",
+                     masteringDisplay,
+                     contentLightLevel != nullptr ? contentLightLevel : "unknown");
+    }
+
+    setOutputColorDescription(description);
+}
+
+void WebOSVideoDecoder::setOutputColorDescription(const char* description)
+{
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decoder output color: %s",
+                description);
+
+    SDL_AtomicLock(&m_OutputColorLock);
+    SDL_strlcpy(m_OutputColorDescription, description, sizeof(m_OutputColorDescription));
+    SDL_AtomicUnlock(&m_OutputColorLock);
+}
+
+bool WebOSVideoDecoder::processBusMessages()
+{
+    bool healthy = true;
+    GstMessage* msg;
+
+    // Nobody else watches the bus, so this also discards
+    // all the messages we aren't interested in.
+    while ((msg = gst_bus_pop_filtered(m_Bus, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_WARNING | GST_MESSAGE_QOS))) != nullptr) {
+        switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_ERROR:
+        case GST_MESSAGE_WARNING:
+        {
+            GError* error = nullptr;
+            gchar* debugInfo = nullptr;
+
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(msg, &error, &debugInfo);
+                healthy = false;
+            }
+            else {
+                gst_message_parse_warning(msg, &error, &debugInfo);
+            }
+
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "GStreamer %s from %s: %s (%s)",
+                        GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR ? "error" : "warning",
+                        GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)),
+                        error != nullptr ? error->message : "unknown",
+                        debugInfo != nullptr ? debugInfo : "no details");
+
+            g_clear_error(&error);
+            g_free(debugInfo);
+            break;
+        }
+
+        case GST_MESSAGE_QOS:
+        {
+            // Elements post one of these when they drop buffers for being
+            // late, such as a decoder that has fallen behind.
+            GstFormat format;
+            guint64 processed, dropped;
+
+            gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+            if (format == GST_FORMAT_BUFFERS && dropped != (guint64)-1) {
+                guint64 lastDropped = m_QosDroppedBuffers.value(GST_MESSAGE_SRC(msg), 0);
+
+                // The count starts over if the element was reset
+                guint64 newDropped = dropped >= lastDropped ? dropped - lastDropped : dropped;
+                m_QosDroppedBuffers.insert(GST_MESSAGE_SRC(msg), dropped);
+
+                if (newDropped != 0) {
+                    m_InputStats.beginUpdate();
+                    m_InputStats.add(VSC_DECODER_DROPPED_FRAMES, (Uint32)newDropped);
+                    m_InputStats.endUpdate();
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        gst_message_unref(msg);
+    }
+
+    return healthy;
+}
+
+bool WebOSVideoDecoder::resetPipeline()
+{
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                "Resetting GStreamer pipeline after error");
+
+    // Anything still queued in the pipeline is discarded, so the
+    // decoder will need an IDR frame to start over. SDL_GetTicks()
+    // is only 0 right at startup, so it doubles as a "not resetting" flag.
+    SDL_AtomicSet(&m_ResetStartTime, (int)SDL_max(SDL_GetTicks(), 1U));
+
+    gst_element_set_state(m_Pipeline, GST_STATE_NULL);
+    m_QosDroppedBuffers.clear();
+    if (gst_element_set_state(m_Pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to restart GStreamer pipeline");
+        SDL_AtomicSet(&m_ResetStartTime, 0);
+        return false;
+    }
+
+    return true;
+}
+
+void WebOSVideoDecoder::collectVideoStats(VIDEO_STATS& window)
+{
+    m_InputStats.collect(window);
+    m_OutputStats.collect(window);
+
+    window.measurementStartTimestamp = m_ActiveWndStartTime;
+}
+
+void WebOSVideoDecoder::flipVideoStatsWindow()
+{
+    // The appsink's streaming thread records its stats concurrently,
+    // so we roll up a snapshot rather than the live values.
+    VIDEO_STATS activeWndStats = {};
+    collectVideoStats(activeWndStats);
+
+    // Update overlay stats if it's enabled
+    if (Session::get() != nullptr && Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+        VIDEO_STATS lastTwoWndStats = {};
+        VideoStats::add(m_LastWndVideoStats, lastTwoWndStats);
+        VideoStats::add(activeWndStats, lastTwoWndStats);
+
+        char* overlayText = Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug);
+        VideoStats::stringify(lastTwoWndStats, m_VideoFormat, m_VideoWidth, m_VideoHeight, overlayText);
+
+        // Show the color metadata we're actually getting from the decoder
+        SDL_AtomicLock(&m_OutputColorLock);
+        if (m_OutputColorDescription[0] != 0) {
+            sprintf(&overlayText[strlen(overlayText)], "%s\n", m_OutputColorDescription);
+        }
+        SDL_AtomicUnlock(&m_OutputColorLock);
+        Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
+    }
+
+    // Hand this window to the metrics exporter if it's enabled
+    if (Session::get() != nullptr && Session::get()->getMetricsExporter() != nullptr) {
+        VIDEO_STATS exportStats = {};
+        VideoStats::add(activeWndStats, exportStats);
+        Session::get()->getMetricsExporter()->submitVideoStats(exportStats,
+                                                               m_DecoderName.constData(),
+                                                               m_VideoFormat);
+    }
+
+    // Accumulate these values into the global stats
+    VideoStats::add(activeWndStats, m_GlobalVideoStats);
+
+    // Move this window into the last window slot and start the next window
+    SDL_memcpy(&m_LastWndVideoStats, &activeWndStats, sizeof(activeWndStats));
+    m_ActiveWndStartTime = SDL_GetTicks();
+}
+
 int WebOSVideoDecoder::submitDecodeUnit(PDECODE_UNIT du) 
 {
     PLENTRY entry = du->bufferList;
     GstFlowReturn err;
     SDL_assert(!m_TestOnly);
-    
+
+    m_InputStats.beginUpdate();
+
+    if (!m_LastFrameNumber) {
+        m_ActiveWndStartTime = SDL_GetTicks();
+        m_LastFrameNumber = du->frameNumber;
+    }
+    else {
+        // Any frame number greater than m_LastFrameNumber + 1 represents a dropped frame
+        int missingFrames = du->frameNumber - (m_LastFrameNumber + 1);
+        m_InputStats.add(VSC_NETWORK_DROPPED_FRAMES, missingFrames);
+        m_InputStats.add(VSC_TOTAL_FRAMES, missingFrames);
+        m_LastFrameNumber = du->frameNumber;
+    }
+
+    m_InputStats.add(VSC_RECEIVED_FRAMES, 1);
+    m_InputStats.add(VSC_TOTAL_FRAMES, 1);
+    m_InputStats.record(VSS_REASSEMBLY, (LiGetMillis() - du->receiveTimeMs) * 1000);
+
+    m_InputStats.endUpdate();
+
+    // Flip stats windows roughly every second
+    if (SDL_TICKS_PASSED(SDL_GetTicks(), m_ActiveWndStartTime + 1000)) {
+        flipVideoStatsWindow();
+    }
+
+    // Errors are only posted to the bus, so this is where we find
+    // out that the decoder has failed and needs to start over.
+    if (!processBusMessages()) {
+        if (!resetPipeline()) {
+            // Have the session recreate us from scratch
+            SDL_Event event;
+            event.type = SDL_RENDER_DEVICE_RESET;
+            SDL_PushEvent(&event);
+        }
+        return DR_NEED_IDR;
+    }
 
     int requiredBufferSize = du->fullLength;
     if (du->frameType == FRAME_TYPE_IDR) {
@@ -163,16 +783,39 @@ int WebOSVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    GstBuffer * buf;
-    buf = gst_buffer_new_allocate(NULL, requiredBufferSize, NULL);
+    Uint32 allocationsBefore = m_InputBufferAllocations;
+    GstBuffer * buf = getInputBuffer(requiredBufferSize);
+    if (buf == nullptr) {
+        return DR_NEED_IDR;
+    }
+
+    // Even a single buffer decode unit has to be copied, since the
+    // depacketizer frees it as soon as we return and appsrc only
+    // queues the buffer for its streaming thread.
+    GstMapInfo map;
+    if (!gst_buffer_map(buf, &map, GST_MAP_WRITE)) {
+        gst_buffer_unref(buf);
+        return DR_NEED_IDR;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        gst_buffer_fill(buf, offset, entry->data, entry->length);
+        memcpy(map.data + offset, entry->data, entry->length);
         offset += entry->length;
         entry = entry->next;
     }
 
+    gst_buffer_unmap(buf, &map);
+
+    // Pooled buffers are bigger than the frame, and the pool
+    // restores their full size when they're returned
+    gst_buffer_set_size(buf, offset);
+
+    m_InputStats.beginUpdate();
+    m_InputStats.add(VSC_PACKET_BUFFER_ALLOCATIONS, m_InputBufferAllocations - allocationsBefore);
+    m_InputStats.add(VSC_COPIED_BYTES, offset);
+    m_InputStats.endUpdate();
+
     if (du->frameType == FRAME_TYPE_IDR) {
         GST_BUFFER_FLAG_UNSET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
     }
@@ -187,10 +830,60 @@ int WebOSVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     return DR_OK;
 }
 
+void WebOSVideoDecoder::getFinalVideoStats(VIDEO_STATS& stats)
+{
+    // The receive thread that rolls up the stats windows is done
+    // submitting, so we can take over collecting them.
+    if (m_ActiveWndStartTime != 0) {
+        VIDEO_STATS activeWndStats = {};
+        collectVideoStats(activeWndStats);
+        VideoStats::add(activeWndStats, m_GlobalVideoStats);
+        m_ActiveWndStartTime = 0;
+    }
+
+    SDL_memcpy(&stats, &m_GlobalVideoStats, sizeof(stats));
+}
+
+void WebOSVideoDecoder::requestRedraw()
+{
+    if (SDL_AtomicCAS(&m_RedrawPending, 0, 1)) {
+        SDL_Event event;
+
+        // The SDL renderer can only be used on the main thread
+        event.type = SDL_USEREVENT;
+        event.user.code = SDL_CODE_FRAME_READY;
+        SDL_PushEvent(&event);
+    }
+}
+
+void WebOSVideoDecoder::notifyOverlayUpdated(Overlay::OverlayType type)
+{
+    m_Overlay->notifyOverlayUpdated(type);
+
+    // Redraw even if it was disabled, so it disappears
+    requestRedraw();
+}
+
 void WebOSVideoDecoder::renderFrameOnMainThread() 
 {
-    SDL_SetRenderDrawColor(m_Renderer, 255, 0, 0, 255);
+    // Clear the flag first, so an update that arrives
+    // while we're drawing gets another redraw.
+    if (SDL_AtomicSet(&m_RedrawPending, 0) == 0) {
+        return;
+    }
+
+    if (SDL_AtomicGet(&m_VideoStarted)) {
+        // Let the video plane show through everywhere but the overlays
+        SDL_SetRenderDrawColor(m_Renderer, 0, 0, 0, SDL_ALPHA_TRANSPARENT);
+    }
+    else {
+        SDL_SetRenderDrawColor(m_Renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    }
     SDL_RenderClear(m_Renderer);
+
+    // Draw the overlays
+    m_Overlay->render(m_Renderer);
+
     SDL_RenderPresent(m_Renderer);
 }
 
@@ -214,15 +907,67 @@ GstFlowReturn WebOSVideoDecoder::gstSinkNewPreroll(GstElement *sink, gpointer se
 
 GstFlowReturn WebOSVideoDecoder::gstSinkNewSample(GstElement *sink, gpointer self)
 {
+    auto me = reinterpret_cast<WebOSVideoDecoder*>(self);
     GstSample *sample;
-    GstFlowReturn ret;
     g_signal_emit_by_name(sink, "pull-sample", &sample);
+    if (sample == nullptr) {
+        return GST_FLOW_OK;
+    }
+
     GstBuffer *buf = gst_sample_get_buffer(sample);
+    Uint64 now = StreamUtils::getMicroseconds();
+
+    me->m_OutputStats.beginUpdate();
+
+    // appsrc stamps each buffer with the running time it was pushed at,
+    // so the difference from the running time now is how long it spent
+    // in the parser and decoder.
+    GstClockTime pts = GST_BUFFER_PTS(buf);
+    GstClockTime runningTime;
+    if (GST_CLOCK_TIME_IS_VALID(pts) && getRunningTime(sink, &runningTime)) {
+        GstClockTime pushTime = gst_segment_to_running_time(gst_sample_get_segment(sample),
+                                                            GST_FORMAT_TIME, pts);
+        if (GST_CLOCK_TIME_IS_VALID(pushTime) && runningTime >= pushTime) {
+            me->m_OutputStats.record(VSS_DECODE, GST_TIME_AS_USECONDS(runningTime - pushTime));
+        }
+    }
+
+    // The decoder puts its frames on the video plane itself,
+    // so every frame that comes out of it is also rendered.
+    me->m_OutputStats.add(VSC_DECODED_FRAMES, 1);
+    me->m_OutputStats.add(VSC_RENDERED_FRAMES, 1);
+    if (me->m_LastOutputTimeUs != 0) {
+        me->m_OutputStats.record(VSS_DECODED_FRAME_INTERVAL, now - me->m_LastOutputTimeUs);
+    }
+    me->m_LastOutputTimeUs = now;
+
+    int resetStartTime = SDL_AtomicSet(&me->m_ResetStartTime, 0);
+    if (resetStartTime != 0) {
+        // This is the first frame since the pipeline was reset
+        Uint32 recoveryTime = SDL_GetTicks() - (Uint32)resetStartTime;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Pipeline recovered by reset in %u ms",
+                    recoveryTime);
+        me->m_OutputStats.add(VSC_RESET_RECOVERIES, 1);
+        me->m_OutputStats.add(VSC_RESET_RECOVERY_TIME, recoveryTime);
+    }
+
+    me->m_OutputStats.endUpdate();
+
+    // Uncover the video plane once there's something on it. Other frames
+    // don't need the main thread at all, since we've already recorded
+    // their stats and the decoder presents them itself.
+    if (SDL_AtomicCAS(&me->m_VideoStarted, 0, 1)) {
+        me->requestRedraw();
+    }
+
     if (gst_buffer_get_size(buf) == sizeof(LXDEBuffer)) {
         LXDEBuffer lxbuf;
         gst_buffer_extract(buf, 0, &lxbuf, sizeof(LXDEBuffer));
-    } else {
-        qDebug("Sample size %d", gst_buffer_get_size(buf));
+        me->updateOutputColor(lxbuf);
+    }
+    else {
+        me->updateOutputColor(gst_sample_get_caps(sample));
     }
     /* Free the sample now that we are done with it */
     gst_sample_unref(sample);
@@ -3,12 +3,21 @@
 #include <functional>
 
 #include "decoder.h"
+#include "overlaymanager.h"
+#include "videostatsshard.h"
+#include "sdloverlay.h"
+
+#include <QHash>
 
 extern "C" {
 #include <gst/gst.h>
+#include "webos/lxvideo.h"
 }
 
-class WebOSVideoDecoder : public IVideoDecoder {
+// The decoder puts video frames on the TV's video plane, which is
+// composited underneath our SDL window. The SDL layer is only redrawn
+// when an overlay changes, and frames never go through the main thread.
+class WebOSVideoDecoder : public IVideoDecoder, public Overlay::IOverlayRenderer {
 public:
     WebOSVideoDecoder(bool testOnly);
     virtual ~WebOSVideoDecoder() override;
@@ -20,17 +29,100 @@ public:
     virtual QSize getDecoderMaxResolution() override;
     virtual int submitDecodeUnit(PDECODE_UNIT du) override;
     virtual void renderFrameOnMainThread() override;
+    virtual void getFinalVideoStats(VIDEO_STATS& stats) override;
+    virtual void notifyOverlayUpdated(Overlay::OverlayType type) override;
 private:
 
     static GstFlowReturn gstSinkNewPreroll(GstElement *sink, gpointer self);
     static GstFlowReturn gstSinkNewSample(GstElement *sink, gpointer self);
-    
+
+    static QByteArray getElementDescription(const char* envVar, const char* defaultDescription);
+    static QByteArray buildPipelineDescription(PDECODER_PARAMETERS params, QByteArray& decoderName);
+
+    static bool getRunningTime(GstElement* element, GstClockTime* runningTime);
+
+    static bool decodeTestFrame(PDECODER_PARAMETERS params);
+
+    static const char* getHdrTypeName(lxdebufext_hdr_type hdrType);
+
+    // lxvideodec describes each frame's color in its LXDEBuffer, while
+    // a software decoder standing in for it on a desktop uses the caps.
+    // These are only called on the appsink's streaming thread.
+    void updateOutputColor(const LXDEBuffer& lxbuf);
+    void updateOutputColor(GstCaps* caps);
+    void setOutputColorDescription(const char* description);
+
+    bool resizeInputPool(int bufferSize);
+    GstBuffer* getInputBuffer(int size);
+
+    // Returns false if the pipeline has failed
+    bool processBusMessages();
+
+    bool resetPipeline();
+
+    void collectVideoStats(VIDEO_STATS& window);
+
+    void flipVideoStatsWindow();
+
+    // Any thread can ask for a redraw. Requests made before the main
+    // thread gets around to it are coalesced into a single event.
+    void requestRedraw();
+
     GstElement* m_Source;
     GstElement* m_Sink;
     GstElement* m_Pipeline;
+    GstBus* m_Bus;
+
+    // QoS messages carry a running count of dropped buffers for each
+    // element, so we remember the last count to find how many are new
+    QHash<GstObject*, guint64> m_QosDroppedBuffers;
 
     SDL_Renderer* m_Renderer;
-    
+    SDL_atomic_t m_RedrawPending;
+
+    // The SDL layer stays black until the first frame is decoded,
+    // then it's cleared so the video plane shows through.
+    SDL_atomic_t m_VideoStarted;
+
+    SdlOverlay* m_Overlay;
+
+    // appsrc queues buffers until the pipeline gets to them, so decode
+    // units are copied into buffers from this pool rather than newly
+    // allocated ones. Buffers return to the pool when GStreamer drops them.
+    GstBufferPool* m_InputPool;
+    int m_InputBufferSize;
+    Uint32 m_InputBufferAllocations;
+
+    // Recorded by the receive thread as frames are pushed into the pipeline
+    VideoStatsShard m_InputStats;
+
+    // Recorded by the appsink's streaming thread as frames come out of the decoder
+    VideoStatsShard m_OutputStats;
+    Uint64 m_LastOutputTimeUs;
+    bool m_HaveOutputHdrInfo;
+    lxdebufext_hdr_type m_OutputHdrType;
+    HDR_header m_OutputHdrHeader;
+    HDR_SEI m_OutputHdrSei;
+    GstCaps* m_OutputCaps;
+
+    // Shown in the debug overlay
+    SDL_SpinLock m_OutputColorLock;
+    char m_OutputColorDescription[256];
+
+    // Set by the receive thread when it resets the pipeline, and
+    // cleared by the streaming thread when the next frame comes out
+    SDL_atomic_t m_ResetStartTime;
+
+    VIDEO_STATS m_LastWndVideoStats;
+    VIDEO_STATS m_GlobalVideoStats;
+    Uint32 m_ActiveWndStartTime;
+    int m_LastFrameNumber;
+
+    QByteArray m_DecoderName;
+    int m_VideoFormat;
+    int m_VideoWidth;
+    int m_VideoHeight;
+
     bool m_NeedsSpsFixup;
     bool m_TestOnly;
 };
\ No newline at end of file